@@ -0,0 +1,401 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <gtk/gtk.h>
+
+#include "config.h"
+#include "spectrum.h"
+#include "utils.h"
+#include "analysis.h"
+#include "window.h"
+#include "profile.h"
+
+// Engines in use, protects their refcount and listeners as well
+static struct spectrum_analysis_t *engines = NULL;
+static intptr_t engines_mutex = 0;
+// The FFTW planner isn't thread safe, plans are made and destroyed one at a time
+static intptr_t planner_mutex = 0;
+
+static uint32_t channel_list[] = {
+    DDB_SPEAKER_FRONT_LEFT,
+    DDB_SPEAKER_FRONT_RIGHT,
+    DDB_SPEAKER_FRONT_CENTER,
+    DDB_SPEAKER_LOW_FREQUENCY,
+    DDB_SPEAKER_BACK_LEFT,
+    DDB_SPEAKER_BACK_RIGHT,
+    DDB_SPEAKER_FRONT_LEFT_OF_CENTER,
+    DDB_SPEAKER_FRONT_RIGHT_OF_CENTER,
+    DDB_SPEAKER_BACK_CENTER,
+    DDB_SPEAKER_SIDE_LEFT,
+    DDB_SPEAKER_SIDE_RIGHT,
+    DDB_SPEAKER_TOP_CENTER,
+    DDB_SPEAKER_TOP_FRONT_LEFT,
+    DDB_SPEAKER_TOP_FRONT_CENTER,
+    DDB_SPEAKER_TOP_FRONT_RIGHT,
+    DDB_SPEAKER_TOP_BACK_LEFT,
+    DDB_SPEAKER_TOP_BACK_CENTER,
+    DDB_SPEAKER_TOP_BACK_RIGHT,
+    0,
+};
+
+static int
+skip_channel (int channel, uint32_t channel_mask, uint32_t channels)
+{
+    int ch_temp = 0;
+    int i = 0;
+    int ch_id = channel_list[i];
+    while (ch_id != 0) {
+        if (channel_mask & ch_id) {
+            if (ch_temp == channel) {
+                if (channels & ch_id) {
+                    return 0;
+                }
+                else {
+                    return 1;
+                }
+            }
+            ch_temp++;
+        }
+        i++;
+        ch_id = channel_list[i];
+    }
+
+    return 1;
+}
+
+static void
+do_fft (struct spectrum_analysis_t *a)
+{
+    const int fft_size = a->params.fft_size;
+    for (int i = 0; i <= fft_size/2; ++i) {
+        a->spectrum[i] = -DBL_MAX;
+    }
+
+    const double fft_squared = fft_size * fft_size;
+
+    for (int ch = 0; ch < a->num_channels; ++ch) {
+        if (skip_channel (ch, a->channel_mask, a->params.channels)) {
+            continue;
+        }
+        for (int i = 0; i < fft_size; i++) {
+            a->fft_in[i] = a->samples[i * a->num_channels + ch] * a->window[i];
+        }
+
+        fftw_execute (a->fft_plan);
+        for (int i = 0; i < fft_size/2; i++) {
+            const double real = a->fft_out[i][0];
+            const double imag = a->fft_out[i][1];
+            const double mag = 10.0 * log10 (4.0 * (real*real + imag*imag)/ fft_squared);
+            a->spectrum[i] = MAX (mag, a->spectrum[i]);
+        }
+    }
+}
+
+static void
+spectrum_analysis_listener (void *ctx, ddb_audio_data_t *data)
+{
+    struct spectrum_analysis_t *a = ctx;
+    spectrum_trace_thread_name ("audio");
+    const gint64 start = spectrum_profile_begin ();
+
+    const int channels = data->fmt->channels;
+    const int nframes = data->nframes;
+    const int fft_size = a->params.fft_size;
+    const int sz = channels * MIN (fft_size, nframes);
+    const int n = channels * fft_size - sz;
+
+    deadbeef->mutex_lock (a->mutex);
+    if (!a->ready) {
+        deadbeef->mutex_unlock (a->mutex);
+        return;
+    }
+    if (channels > a->samples_channels) {
+        // Only happens when the output format changes
+        float *samples = realloc (a->samples, (size_t)fft_size * channels * sizeof (float));
+        if (!samples) {
+            deadbeef->mutex_unlock (a->mutex);
+            return;
+        }
+        memset (samples, 0, (size_t)fft_size * channels * sizeof (float));
+        a->samples = samples;
+        a->samples_channels = channels;
+    }
+    memmove (a->samples, a->samples + sz, n * sizeof (float));
+    memcpy (a->samples + n, data->data, sz * sizeof (float));
+
+    a->num_channels = channels;
+    a->channel_mask = data->fmt->channelmask;
+    a->generation++;
+    deadbeef->mutex_unlock (a->mutex);
+    spectrum_profile_end (a->profile, PROFILE_INGEST, start);
+}
+
+// Buffers and the FFT plan are only needed once the engine gets samples and
+// are set up off the main thread, so creating a widget stays cheap
+static void
+spectrum_analysis_plan_thread (void *ctx)
+{
+    struct spectrum_analysis_t *a = ctx;
+    spectrum_trace_thread_name ("fft planner");
+    const int fft_size = a->params.fft_size;
+    // Sized for stereo, the listener makes room for more channels
+    const int samples_channels = 2;
+    float *samples = calloc (fft_size * samples_channels, sizeof (float));
+    double *spectrum = calloc (fft_size / 2 + 1, sizeof (double));
+    double *fft_in = fftw_alloc_real (fft_size);
+    fftw_complex *fft_out = fftw_alloc_complex (fft_size / 2 + 1);
+
+    deadbeef->mutex_lock (planner_mutex);
+    const gint64 start = spectrum_trace_begin ();
+    fftw_plan fft_plan = fftw_plan_dft_r2c_1d (fft_size, fft_in, fft_out, FFTW_ESTIMATE);
+    spectrum_trace_end ("fftw_plan", start);
+    deadbeef->mutex_unlock (planner_mutex);
+    const double *window = spectrum_window_get (a->params.window, fft_size);
+
+    deadbeef->mutex_lock (a->mutex);
+    a->samples = samples;
+    a->samples_channels = samples_channels;
+    a->spectrum = spectrum;
+    a->fft_in = fft_in;
+    a->fft_out = fft_out;
+    a->fft_plan = fft_plan;
+    a->window = window;
+    a->ready = 1;
+    deadbeef->mutex_unlock (a->mutex);
+}
+
+// Waits for the planner thread, called with the registry lock held
+static void
+spectrum_analysis_plan_join (struct spectrum_analysis_t *a)
+{
+    if (a->planner) {
+        deadbeef->thread_join (a->planner);
+        a->planner = 0;
+    }
+}
+
+static struct spectrum_analysis_t *
+spectrum_analysis_new (struct spectrum_analysis_params_t *params)
+{
+    struct spectrum_analysis_t *a = calloc (1, sizeof (struct spectrum_analysis_t));
+    a->params = *params;
+    a->mutex = deadbeef->mutex_create ();
+    a->profile = spectrum_profile_new ();
+    // Compute the first spectrum even if no samples arrive
+    a->spectrum_generation = (uint64_t)-1;
+    return a;
+}
+
+static void
+spectrum_analysis_free (struct spectrum_analysis_t *a)
+{
+    if (!a) {
+        return;
+    }
+    if (a->fft_plan) {
+        deadbeef->mutex_lock (planner_mutex);
+        fftw_destroy_plan (a->fft_plan);
+        deadbeef->mutex_unlock (planner_mutex);
+        a->fft_plan = NULL;
+    }
+    if (a->fft_in) {
+        fftw_free (a->fft_in);
+        a->fft_in = NULL;
+    }
+    if (a->fft_out) {
+        fftw_free (a->fft_out);
+        a->fft_out = NULL;
+    }
+    if (a->samples) {
+        free (a->samples);
+        a->samples = NULL;
+    }
+    if (a->spectrum) {
+        free (a->spectrum);
+        a->spectrum = NULL;
+    }
+    // the window table belongs to the cache
+    a->window = NULL;
+    if (a->mutex) {
+        deadbeef->mutex_free (a->mutex);
+        a->mutex = 0;
+    }
+    if (a->profile) {
+        spectrum_profile_free (a->profile);
+        a->profile = NULL;
+    }
+    free (a);
+    a = NULL;
+}
+
+void
+spectrum_analysis_init (void)
+{
+    engines_mutex = deadbeef->mutex_create ();
+    planner_mutex = deadbeef->mutex_create ();
+    spectrum_window_init ();
+}
+
+void
+spectrum_analysis_cleanup (void)
+{
+    // Instances which haven't been destroyed yet still need it
+    if (engines_mutex && !engines) {
+        deadbeef->mutex_free (engines_mutex);
+        engines_mutex = 0;
+        deadbeef->mutex_free (planner_mutex);
+        planner_mutex = 0;
+        spectrum_window_cleanup ();
+    }
+}
+
+struct spectrum_analysis_params_t
+spectrum_analysis_params_get (void)
+{
+    const struct spectrum_config_t *c = config_get ();
+    struct spectrum_analysis_params_t params = {
+        .fft_size = c->fft_size,
+        .window = c->window,
+        .channels = c->channels,
+    };
+    return params;
+}
+
+int
+spectrum_analysis_matches (struct spectrum_analysis_t *a, struct spectrum_analysis_params_t *params)
+{
+    return a && a->params.fft_size == params->fft_size
+        && a->params.window == params->window
+        && a->params.channels == params->channels;
+}
+
+struct spectrum_analysis_t *
+spectrum_analysis_acquire (struct spectrum_analysis_params_t *params)
+{
+    deadbeef->mutex_lock (engines_mutex);
+    struct spectrum_analysis_t *a = engines;
+    while (a && !spectrum_analysis_matches (a, params)) {
+        a = a->next;
+    }
+    if (!a) {
+        a = spectrum_analysis_new (params);
+        a->next = engines;
+        engines = a;
+    }
+    a->refcount++;
+    deadbeef->mutex_unlock (engines_mutex);
+    return a;
+}
+
+void
+spectrum_analysis_release (struct spectrum_analysis_t *a)
+{
+    if (!a) {
+        return;
+    }
+    deadbeef->mutex_lock (engines_mutex);
+    if (--a->refcount > 0) {
+        deadbeef->mutex_unlock (engines_mutex);
+        return;
+    }
+    for (struct spectrum_analysis_t **e = &engines; *e; e = &(*e)->next) {
+        if (*e == a) {
+            *e = a->next;
+            break;
+        }
+    }
+    spectrum_analysis_plan_join (a);
+    deadbeef->mutex_unlock (engines_mutex);
+    spectrum_analysis_free (a);
+}
+
+void
+spectrum_analysis_listen (struct spectrum_analysis_t *a)
+{
+    deadbeef->mutex_lock (engines_mutex);
+    if (!a->planned) {
+        a->planned = 1;
+        a->planner = deadbeef->thread_start (spectrum_analysis_plan_thread, a);
+    }
+    if (a->listeners++ == 0) {
+        deadbeef->vis_waveform_listen (a, spectrum_analysis_listener);
+    }
+    deadbeef->mutex_unlock (engines_mutex);
+}
+
+void
+spectrum_analysis_wait (struct spectrum_analysis_t *a)
+{
+    deadbeef->mutex_lock (engines_mutex);
+    spectrum_analysis_plan_join (a);
+    deadbeef->mutex_unlock (engines_mutex);
+}
+
+void
+spectrum_analysis_unlisten (struct spectrum_analysis_t *a)
+{
+    deadbeef->mutex_lock (engines_mutex);
+    if (--a->listeners == 0) {
+        deadbeef->vis_waveform_unlisten (a);
+    }
+    deadbeef->mutex_unlock (engines_mutex);
+}
+
+size_t
+spectrum_analysis_memory (struct spectrum_analysis_t *a)
+{
+    const size_t fft_size = a->params.fft_size;
+    deadbeef->mutex_lock (a->mutex);
+    const int ready = a->ready;
+    const size_t samples = fft_size * a->samples_channels * sizeof (float);
+    deadbeef->mutex_unlock (a->mutex);
+    if (!ready) {
+        return sizeof (struct spectrum_analysis_t);
+    }
+    return sizeof (struct spectrum_analysis_t)
+        + samples
+        + (fft_size / 2 + 1) * sizeof (double)
+        + fft_size * sizeof (double)
+        + (fft_size / 2 + 1) * sizeof (fftw_complex);
+}
+
+int
+spectrum_analysis_get (struct spectrum_analysis_t *a, double *spectrum)
+{
+    deadbeef->mutex_lock (a->mutex);
+    if (!a->ready) {
+        deadbeef->mutex_unlock (a->mutex);
+        return 0;
+    }
+    // The first instance which needs the spectrum of the current block computes it
+    if (a->spectrum_generation != a->generation) {
+        const gint64 start = spectrum_profile_begin ();
+        do_fft (a);
+        spectrum_profile_end (a->profile, PROFILE_FFT, start);
+        a->spectrum_generation = a->generation;
+    }
+    memcpy (spectrum, a->spectrum, (a->params.fft_size / 2 + 1) * sizeof (double));
+    deadbeef->mutex_unlock (a->mutex);
+    return 1;
+}
@@ -0,0 +1,109 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <fftw3.h>
+
+// Settings which affect the result of the analysis, instances with equal
+// parameters share one engine
+struct spectrum_analysis_params_t {
+    int fft_size;
+    int window;
+    uint32_t channels;
+};
+
+// Sample ring and FFT shared by all instances with the same parameters
+struct spectrum_analysis_t {
+    struct spectrum_analysis_params_t params;
+    // number of instances using it and how many of them are visible,
+    // protected by the registry lock
+    int refcount;
+    int listeners;
+
+    // thread setting up the buffers and the plan, started by the first listener
+    intptr_t planner;
+    int planned;
+
+    // protects the fields below
+    intptr_t mutex;
+    // buffers and plan are set up
+    int ready;
+    int num_channels;
+    uint32_t channel_mask;
+    // interleaved ring of the last fft_size frames, room for samples_channels
+    float *samples;
+    int samples_channels;
+    const double *window;
+    double *fft_in;
+    fftw_complex *fft_out;
+    fftw_plan fft_plan;
+    // magnitudes in dB of the first fft_size/2 bins, followed by silence
+    double *spectrum;
+    // incremented for every block of samples, the spectrum is only computed once per block
+    uint64_t generation;
+    uint64_t spectrum_generation;
+    // timings of ingest and FFT
+    struct spectrum_profile_t *profile;
+
+    struct spectrum_analysis_t *next;
+};
+
+void
+spectrum_analysis_init (void);
+
+void
+spectrum_analysis_cleanup (void);
+
+// Parameters of the config the calling thread uses
+struct spectrum_analysis_params_t
+spectrum_analysis_params_get (void);
+
+int
+spectrum_analysis_matches (struct spectrum_analysis_t *a, struct spectrum_analysis_params_t *params);
+
+// Returns an engine with the given parameters, creates one if there is none yet
+struct spectrum_analysis_t *
+spectrum_analysis_acquire (struct spectrum_analysis_params_t *params);
+
+void
+spectrum_analysis_release (struct spectrum_analysis_t *a);
+
+// The engine receives samples as long as one of its instances listens
+void
+spectrum_analysis_listen (struct spectrum_analysis_t *a);
+
+void
+spectrum_analysis_unlisten (struct spectrum_analysis_t *a);
+
+// Blocks until the buffers and the FFT plan of a listened engine are set up
+void
+spectrum_analysis_wait (struct spectrum_analysis_t *a);
+
+// Bytes allocated by the engine, the shared window table is not included
+size_t
+spectrum_analysis_memory (struct spectrum_analysis_t *a);
+
+// Copies the magnitudes of the latest samples to spectrum, fft_size/2 + 1 values.
+// Returns 0 and leaves spectrum untouched while the engine is being set up.
+int
+spectrum_analysis_get (struct spectrum_analysis_t *a, double *spectrum);
@@ -0,0 +1,262 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "spectrum.h"
+#include "api.h"
+
+struct spectrum_api_subscriber_t {
+    int id;
+    int instance;
+    ddb_spectrum_callback_t callback;
+    void *user_data;
+};
+
+// Protects the publishers, their latest frames and the subscribers. It's
+// recursive and held while the callbacks run, so they may use the API, and
+// unsubscribe can wait for a running callback.
+static uintptr_t api_mutex;
+static GSList *publishers = NULL;
+static struct spectrum_api_subscriber_t subscribers[API_MAX_SUBSCRIBERS];
+static int last_id = 0;
+static int api_used = 0;
+
+void
+spectrum_api_init (void)
+{
+    api_mutex = deadbeef->mutex_create ();
+}
+
+void
+spectrum_api_cleanup (void)
+{
+    // The widgets are gone, so are their publishers
+    g_slist_free (publishers);
+    publishers = NULL;
+    memset (subscribers, 0, sizeof (subscribers));
+    if (api_mutex) {
+        deadbeef->mutex_free (api_mutex);
+        api_mutex = 0;
+    }
+}
+
+int
+spectrum_api_used (void)
+{
+    return __atomic_load_n (&api_used, __ATOMIC_RELAXED);
+}
+
+static void
+spectrum_api_use (void)
+{
+    __atomic_store_n (&api_used, 1, __ATOMIC_RELAXED);
+}
+
+static void
+spectrum_api_frame_unref (struct spectrum_api_frame_t *f)
+{
+    if (!f) {
+        return;
+    }
+    if (__atomic_sub_fetch (&f->refcount, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+    free (f);
+    f = NULL;
+}
+
+struct spectrum_api_publisher_t *
+spectrum_api_publisher_new (void)
+{
+    struct spectrum_api_publisher_t *p = calloc (1, sizeof (struct spectrum_api_publisher_t));
+    if (!p) {
+        return NULL;
+    }
+    p->instance = -1;
+    deadbeef->mutex_lock (api_mutex);
+    publishers = g_slist_prepend (publishers, p);
+    deadbeef->mutex_unlock (api_mutex);
+    return p;
+}
+
+void
+spectrum_api_publisher_free (struct spectrum_api_publisher_t *p)
+{
+    if (!p) {
+        return;
+    }
+    deadbeef->mutex_lock (api_mutex);
+    publishers = g_slist_remove (publishers, p);
+    struct spectrum_api_frame_t *latest = p->latest;
+    p->latest = NULL;
+    deadbeef->mutex_unlock (api_mutex);
+
+    spectrum_api_frame_unref (latest);
+    for (int i = 0; i < API_POOL; i++) {
+        spectrum_api_frame_unref (p->pool[i]);
+        p->pool[i] = NULL;
+    }
+    free (p);
+    p = NULL;
+}
+
+struct spectrum_api_frame_t *
+spectrum_api_frame_begin (struct spectrum_api_publisher_t *p, int num_bins, int num_bands)
+{
+    const int capacity = num_bins + 3 * num_bands;
+
+    // A frame only the pool holds is neither the latest nor used by a
+    // consumer, and can't become either before we commit it
+    int slot = -1;
+    for (int i = 0; i < API_POOL; i++) {
+        struct spectrum_api_frame_t *f = p->pool[i];
+        if (f && __atomic_load_n (&f->refcount, __ATOMIC_ACQUIRE) != 1) {
+            continue;
+        }
+        if (slot < 0 || (f && f->capacity >= capacity)) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        // Consumers hold on to all of them, leave one to them
+        slot = p->pool[0] != p->latest ? 0 : 1;
+        spectrum_api_frame_unref (p->pool[slot]);
+        p->pool[slot] = NULL;
+    }
+
+    struct spectrum_api_frame_t *f = p->pool[slot];
+    if (!f || f->capacity < capacity) {
+        struct spectrum_api_frame_t *grown = realloc (f, sizeof (struct spectrum_api_frame_t) + capacity * sizeof (double));
+        if (!grown) {
+            return NULL;
+        }
+        f = grown;
+        f->refcount = 1;
+        f->capacity = capacity;
+        p->pool[slot] = f;
+    }
+
+    f->spectrum = f->data;
+    f->bands = f->spectrum + num_bins;
+    f->peaks = f->bands + num_bands;
+    f->frequency = f->peaks + num_bands;
+    f->frame.num_bins = num_bins;
+    f->frame.spectrum = f->spectrum;
+    f->frame.num_bands = num_bands;
+    f->frame.bands = f->bands;
+    f->frame.peaks = f->peaks;
+    f->frame.frequency = f->frequency;
+    return f;
+}
+
+void
+spectrum_api_frame_commit (struct spectrum_api_publisher_t *p, struct spectrum_api_frame_t *f, int instance)
+{
+    f->frame.instance = instance;
+    f->frame.frame = ++p->frame;
+    f->frame.timestamp = g_get_monotonic_time ();
+    // the reference of latest
+    __atomic_add_fetch (&f->refcount, 1, __ATOMIC_ACQ_REL);
+
+    deadbeef->mutex_lock (api_mutex);
+    p->instance = instance;
+    struct spectrum_api_frame_t *prev = p->latest;
+    p->latest = f;
+    for (int i = 0; i < API_MAX_SUBSCRIBERS; i++) {
+        struct spectrum_api_subscriber_t *s = &subscribers[i];
+        if (s->callback && (s->instance == -1 || s->instance == instance)) {
+            s->callback (&f->frame, s->user_data);
+        }
+    }
+    deadbeef->mutex_unlock (api_mutex);
+
+    spectrum_api_frame_unref (prev);
+}
+
+const ddb_spectrum_frame_t *
+spectrum_api_frame_acquire (int instance)
+{
+    spectrum_api_use ();
+    struct spectrum_api_frame_t *f = NULL;
+    deadbeef->mutex_lock (api_mutex);
+    for (GSList *l = publishers; l != NULL; l = l->next) {
+        struct spectrum_api_publisher_t *p = l->data;
+        if (p->latest && p->instance == instance) {
+            f = p->latest;
+            __atomic_add_fetch (&f->refcount, 1, __ATOMIC_ACQ_REL);
+            break;
+        }
+    }
+    deadbeef->mutex_unlock (api_mutex);
+    return f ? &f->frame : NULL;
+}
+
+void
+spectrum_api_frame_ref (const ddb_spectrum_frame_t *frame)
+{
+    struct spectrum_api_frame_t *f = (struct spectrum_api_frame_t *)frame;
+    __atomic_add_fetch (&f->refcount, 1, __ATOMIC_ACQ_REL);
+}
+
+void
+spectrum_api_frame_release (const ddb_spectrum_frame_t *frame)
+{
+    spectrum_api_frame_unref ((struct spectrum_api_frame_t *)frame);
+}
+
+int
+spectrum_api_subscribe (int instance, ddb_spectrum_callback_t callback, void *user_data)
+{
+    if (!callback) {
+        return -1;
+    }
+    spectrum_api_use ();
+    int id = -1;
+    deadbeef->mutex_lock (api_mutex);
+    for (int i = 0; i < API_MAX_SUBSCRIBERS; i++) {
+        struct spectrum_api_subscriber_t *s = &subscribers[i];
+        if (!s->callback) {
+            id = ++last_id;
+            s->id = id;
+            s->instance = instance;
+            s->callback = callback;
+            s->user_data = user_data;
+            break;
+        }
+    }
+    deadbeef->mutex_unlock (api_mutex);
+    return id;
+}
+
+void
+spectrum_api_unsubscribe (int id)
+{
+    deadbeef->mutex_lock (api_mutex);
+    for (int i = 0; i < API_MAX_SUBSCRIBERS; i++) {
+        if (subscribers[i].callback && subscribers[i].id == id) {
+            memset (&subscribers[i], 0, sizeof (struct spectrum_api_subscriber_t));
+            break;
+        }
+    }
+    deadbeef->mutex_unlock (api_mutex);
+}
@@ -0,0 +1,94 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include "spectrum_api.h"
+
+// Frames in a publisher's pool, enough for a consumer holding on to one or
+// two frames without making us allocate
+#define API_POOL 4
+#define API_MAX_SUBSCRIBERS 16
+
+struct spectrum_api_frame_t {
+    // what consumers get, must be the first member
+    ddb_spectrum_frame_t frame;
+    int refcount;
+    int capacity;
+    // writable views of the arrays of frame
+    double *spectrum;
+    double *bands;
+    double *peaks;
+    double *frequency;
+    double data[];
+};
+
+// Publishes the frames of one widget. Only used by its render worker, apart
+// from the list of publishers, which is protected by the api mutex.
+struct spectrum_api_publisher_t {
+    int instance;
+    uint64_t frame;
+    // frames we can reuse once nobody else holds a reference
+    struct spectrum_api_frame_t *pool[API_POOL];
+    // holds its own reference, protected by the api mutex
+    struct spectrum_api_frame_t *latest;
+};
+
+void
+spectrum_api_init (void);
+
+void
+spectrum_api_cleanup (void);
+
+// True once a consumer used the API
+int
+spectrum_api_used (void);
+
+struct spectrum_api_publisher_t *
+spectrum_api_publisher_new (void);
+
+// Consumers keep the frames they hold
+void
+spectrum_api_publisher_free (struct spectrum_api_publisher_t *p);
+
+// Returns a frame to fill with num_bins bins and num_bands bands, NULL if
+// out of memory
+struct spectrum_api_frame_t *
+spectrum_api_frame_begin (struct spectrum_api_publisher_t *p, int num_bins, int num_bands);
+
+// Makes the frame the latest of the instance and hands it to the subscribers
+void
+spectrum_api_frame_commit (struct spectrum_api_publisher_t *p, struct spectrum_api_frame_t *f, int instance);
+
+// Functions of ddb_musical_spectrum_t
+const ddb_spectrum_frame_t *
+spectrum_api_frame_acquire (int instance);
+
+void
+spectrum_api_frame_ref (const ddb_spectrum_frame_t *frame);
+
+void
+spectrum_api_frame_release (const ddb_spectrum_frame_t *frame);
+
+int
+spectrum_api_subscribe (int instance, ddb_spectrum_callback_t callback, void *user_data);
+
+void
+spectrum_api_unsubscribe (int id);
@@ -0,0 +1,83 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+struct spectrum_arena_t *
+spectrum_arena_new (void)
+{
+    return calloc (1, sizeof (struct spectrum_arena_t));
+}
+
+void
+spectrum_arena_free (struct spectrum_arena_t *arena)
+{
+    if (!arena) {
+        return;
+    }
+    if (arena->base) {
+        free (arena->base);
+        arena->base = NULL;
+    }
+    free (arena);
+    arena = NULL;
+}
+
+size_t
+spectrum_arena_align (size_t size)
+{
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+int
+spectrum_arena_reserve (struct spectrum_arena_t *arena, size_t size)
+{
+    size = spectrum_arena_align (size);
+    arena->used = 0;
+    if (size > arena->size) {
+        if (arena->base) {
+            free (arena->base);
+            arena->base = NULL;
+        }
+        arena->size = 0;
+        if (posix_memalign (&arena->base, ARENA_ALIGNMENT, size) != 0) {
+            arena->base = NULL;
+            return -1;
+        }
+        arena->size = size;
+    }
+    memset (arena->base, 0, size);
+    return 0;
+}
+
+void *
+spectrum_arena_alloc (struct spectrum_arena_t *arena, size_t size)
+{
+    size = spectrum_arena_align (size);
+    if (!arena->base || arena->used + size > arena->size) {
+        return NULL;
+    }
+    void *ptr = (char *)arena->base + arena->used;
+    arena->used += size;
+    return ptr;
+}
@@ -0,0 +1,55 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+// Allocations are aligned to cache lines, so arrays carved from the same
+// arena never share one
+#define ARENA_ALIGNMENT 64
+
+// One block of memory from which several arrays are carved. The arrays live
+// as long as the arena and are given back all at once.
+struct spectrum_arena_t {
+    void *base;
+    size_t size;
+    size_t used;
+};
+
+struct spectrum_arena_t *
+spectrum_arena_new (void);
+
+void
+spectrum_arena_free (struct spectrum_arena_t *arena);
+
+// Size of an allocation including the padding to the next cache line
+size_t
+spectrum_arena_align (size_t size);
+
+// Makes room for size bytes and zeroes them. Everything allocated before is
+// given back, the block is only replaced if it is too small. Returns 0 on
+// success.
+int
+spectrum_arena_reserve (struct spectrum_arena_t *arena, size_t size);
+
+// Carves size zeroed bytes from the reserved space, NULL if it is used up
+void *
+spectrum_arena_alloc (struct spectrum_arena_t *arena, size_t size);
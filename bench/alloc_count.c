@@ -0,0 +1,223 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Counts heap allocations, preloaded into the benchmark with LD_PRELOAD for
+// the allocation check (bench -a). Allocations are forwarded to glibc, only
+// while counting is on they are attributed by the cairo call the plugin made:
+// - path building calls grow the path buffer cairo keeps, they are exempt
+// - drawing calls like cairo_fill rasterize with buffers of cairo and pixman,
+//   they are reported separately and don't fail the check either
+// - anything else, e.g. creating patterns or surfaces, counts as an
+//   allocation of the plugin
+// So the guarantee covers the plugin's own code, not what cairo does inside
+// of the drawing calls.
+
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+
+#define MAX_FRAMES 48
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+enum ALLOC_KIND {
+    ALLOC_PLUGIN,
+    ALLOC_PATH,
+    ALLOC_DRAWING,
+    NUM_ALLOC_KIND
+};
+
+static int counting;
+static long allocations[NUM_ALLOC_KIND];
+static __thread int in_hook;
+
+// Cairo calls which only add to the path
+static const char *path_calls[] = {
+    "cairo_move_to",
+    "cairo_line_to",
+    "cairo_rel_move_to",
+    "cairo_rel_line_to",
+    "cairo_curve_to",
+    "cairo_rectangle",
+    "cairo_arc",
+    "cairo_close_path",
+    "cairo_new_path",
+    NULL,
+};
+
+// Cairo calls which rasterize
+static const char *drawing_calls[] = {
+    "cairo_fill",
+    "cairo_fill_preserve",
+    "cairo_stroke",
+    "cairo_stroke_preserve",
+    "cairo_clip",
+    "cairo_paint",
+    "cairo_paint_with_alpha",
+    "cairo_mask",
+    NULL,
+};
+
+static int
+alloc_count_in_cairo (const Dl_info *info)
+{
+    return info->dli_fname && (strstr (info->dli_fname, "libcairo") || strstr (info->dli_fname, "libpixman"));
+}
+
+static int
+alloc_count_listed (const char *name, const char **calls)
+{
+    for (int i = 0; calls[i]; i++) {
+        if (!strcmp (name, calls[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Walks up from the allocation to the cairo function called from outside of
+// cairo and pixman and looks it up in the lists above
+static enum ALLOC_KIND
+alloc_count_kind (void)
+{
+    void *frames[MAX_FRAMES];
+    const int num_frames = backtrace (frames, MAX_FRAMES);
+    Dl_info self;
+    if (!dladdr ((void *)alloc_count_kind, &self)) {
+        return ALLOC_PLUGIN;
+    }
+    const char *entry = NULL;
+    for (int i = 0; i < num_frames; i++) {
+        Dl_info info;
+        // return addresses point behind the call, which may be the next function
+        if (!dladdr ((char *)frames[i] - 1, &info)) {
+            break;
+        }
+        if (info.dli_fbase == self.dli_fbase) {
+            continue;
+        }
+        if (!alloc_count_in_cairo (&info)) {
+            break;
+        }
+        // symbols internal to cairo resolve to the closest exported one, only
+        // the entry point gets matched
+        entry = info.dli_sname;
+    }
+    if (!entry) {
+        return ALLOC_PLUGIN;
+    }
+    if (alloc_count_listed (entry, path_calls)) {
+        return ALLOC_PATH;
+    }
+    if (alloc_count_listed (entry, drawing_calls)) {
+        return ALLOC_DRAWING;
+    }
+    return ALLOC_PLUGIN;
+}
+
+static void
+alloc_count_add (void)
+{
+    if (!__atomic_load_n (&counting, __ATOMIC_RELAXED) || in_hook) {
+        return;
+    }
+    in_hook = 1;
+    __atomic_add_fetch (&allocations[alloc_count_kind ()], 1, __ATOMIC_RELAXED);
+    in_hook = 0;
+}
+
+void
+alloc_count_start (void)
+{
+    // The first backtrace loads the unwinder, which must not happen in the hook
+    void *frame;
+    backtrace (&frame, 1);
+    for (int i = 0; i < NUM_ALLOC_KIND; i++) {
+        __atomic_store_n (&allocations[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n (&counting, 1, __ATOMIC_RELEASE);
+}
+
+// Returns the number of allocations of the plugin since alloc_count_start,
+// the ones for paths and in drawing calls are stored in path and drawing
+long
+alloc_count_stop (long *path, long *drawing)
+{
+    __atomic_store_n (&counting, 0, __ATOMIC_RELEASE);
+    if (path) {
+        *path = __atomic_load_n (&allocations[ALLOC_PATH], __ATOMIC_RELAXED);
+    }
+    if (drawing) {
+        *drawing = __atomic_load_n (&allocations[ALLOC_DRAWING], __ATOMIC_RELAXED);
+    }
+    return __atomic_load_n (&allocations[ALLOC_PLUGIN], __ATOMIC_RELAXED);
+}
+
+void *
+malloc (size_t size)
+{
+    alloc_count_add ();
+    return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+    alloc_count_add ();
+    return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+    alloc_count_add ();
+    return __libc_realloc (ptr, size);
+}
+
+void *
+memalign (size_t alignment, size_t size)
+{
+    alloc_count_add ();
+    return __libc_memalign (alignment, size);
+}
+
+void *
+aligned_alloc (size_t alignment, size_t size)
+{
+    alloc_count_add ();
+    return __libc_memalign (alignment, size);
+}
+
+int
+posix_memalign (void **ptr, size_t alignment, size_t size)
+{
+    alloc_count_add ();
+    void *p = __libc_memalign (alignment, size);
+    if (!p) {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
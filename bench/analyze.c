@@ -0,0 +1,506 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+// Runs a WAV or raw PCM file through the analysis and band mapping of the
+// plugin and writes the bands of every frame, or compares two such runs.
+// Meant for checking that changes to the DSP code keep the results.
+//
+//   analyze [options] input.wav output.bin|output.csv
+//   analyze -C [-t tolerance] reference.bin result.bin
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+
+#include <deadbeef/deadbeef.h>
+#include <deadbeef/gtkui_api.h>
+
+#include "../config.h"
+#include "../spectrum.h"
+#include "../render.h"
+#include "../utils.h"
+#include "../analysis.h"
+#include "stub.h"
+
+#define ANALYZE_MAGIC "MSBA"
+#define ANALYZE_VERSION 1
+// values below are treated as equal when comparing, silence is -DBL_MAX
+#define DB_FLOOR -200.0
+
+// Header of the binary output, followed by num_bands float frequencies and
+// num_bands float dB values per frame, all little endian
+struct analyze_header_t {
+    char magic[4];
+    uint32_t version;
+    uint32_t samplerate;
+    uint32_t fft_size;
+    uint32_t hop;
+    uint32_t num_bands;
+};
+
+struct analyze_input_t {
+    FILE *file;
+    int channels;
+    int samplerate;
+    int bits;
+    int is_float;
+    uint32_t channel_mask;
+    // bytes of sample data left
+    uint64_t remaining;
+};
+
+static uint32_t
+read_u32 (const unsigned char *b)
+{
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uint16_t
+read_u16 (const unsigned char *b)
+{
+    return b[0] | (b[1] << 8);
+}
+
+static int
+analyze_wav_open (struct analyze_input_t *in, const char *path)
+{
+    in->file = fopen (path, "rb");
+    if (!in->file) {
+        perror (path);
+        return -1;
+    }
+    unsigned char riff[12];
+    if (fread (riff, 1, 12, in->file) != 12 || memcmp (riff, "RIFF", 4) || memcmp (riff + 8, "WAVE", 4)) {
+        fprintf (stderr, "%s: not a WAV file\n", path);
+        return -1;
+    }
+    int have_fmt = 0;
+    unsigned char chunk[8];
+    while (fread (chunk, 1, 8, in->file) == 8) {
+        const uint32_t size = read_u32 (chunk + 4);
+        if (!memcmp (chunk, "fmt ", 4)) {
+            unsigned char fmt[40] = {};
+            const uint32_t n = MIN (size, sizeof (fmt));
+            if (fread (fmt, 1, n, in->file) != n) {
+                break;
+            }
+            fseek (in->file, size - n + (size & 1), SEEK_CUR);
+            int format = read_u16 (fmt);
+            in->channels = read_u16 (fmt + 2);
+            in->samplerate = read_u32 (fmt + 4);
+            in->bits = read_u16 (fmt + 14);
+            in->channel_mask = (1u << in->channels) - 1;
+            // WAVE_FORMAT_EXTENSIBLE, the format is the start of the sub format
+            if (format == 0xfffe && n >= 26) {
+                in->channel_mask = read_u32 (fmt + 20);
+                format = read_u16 (fmt + 24);
+            }
+            in->is_float = format == 3;
+            if ((format != 1 && format != 3) || (in->is_float && in->bits != 32)
+                || (!in->is_float && in->bits != 16 && in->bits != 24 && in->bits != 32)) {
+                fprintf (stderr, "%s: unsupported sample format %d with %d bits\n", path, format, in->bits);
+                return -1;
+            }
+            have_fmt = 1;
+        }
+        else if (!memcmp (chunk, "data", 4)) {
+            if (!have_fmt) {
+                break;
+            }
+            in->remaining = size;
+            return 0;
+        }
+        else {
+            fseek (in->file, size + (size & 1), SEEK_CUR);
+        }
+    }
+    fprintf (stderr, "%s: no sample data found\n", path);
+    return -1;
+}
+
+// Reads up to frames frames as interleaved float, returns the number read
+static int
+analyze_read (struct analyze_input_t *in, float *data, int frames, unsigned char *buffer)
+{
+    const int frame_size = in->channels * in->bits / 8;
+    const uint64_t wanted = MIN ((uint64_t)frames * frame_size, in->remaining);
+    const size_t n = fread (buffer, 1, wanted, in->file);
+    in->remaining -= n;
+    const int frames_read = n / frame_size;
+    const int samples = frames_read * in->channels;
+
+    for (int i = 0; i < samples; i++) {
+        const unsigned char *b = buffer + i * in->bits / 8;
+        if (in->is_float) {
+            union { uint32_t i; float f; } v = { .i = read_u32 (b) };
+            data[i] = v.f;
+        }
+        else if (in->bits == 16) {
+            data[i] = (int16_t)read_u16 (b) / 32768.0f;
+        }
+        else if (in->bits == 24) {
+            const int32_t v = (int32_t)((b[0] << 8) | (b[1] << 16) | ((uint32_t)b[2] << 24)) >> 8;
+            data[i] = v / 8388608.0f;
+        }
+        else {
+            data[i] = (int32_t)read_u32 (b) / 2147483648.0f;
+        }
+    }
+    return frames_read;
+}
+
+static void
+write_floats (FILE *out, const double *values, int n)
+{
+    for (int i = 0; i < n; i++) {
+        const float v = values[i];
+        fwrite (&v, sizeof (float), 1, out);
+    }
+}
+
+static double
+now_seconds (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct analyze_options_t {
+    int fft_size;
+    int window;
+    int hop;
+    int style;
+    int width;
+    int csv;
+    // raw input: float samples, channels and samplerate given on the command line
+    int raw;
+    int raw_channels;
+    int raw_samplerate;
+};
+
+static int
+analyze (const struct analyze_options_t *o, const char *input, const char *output)
+{
+    struct analyze_input_t in = {};
+    if (o->raw) {
+        in.file = fopen (input, "rb");
+        if (!in.file) {
+            perror (input);
+            return 1;
+        }
+        in.channels = o->raw_channels;
+        in.samplerate = o->raw_samplerate;
+        in.bits = 32;
+        in.is_float = 1;
+        in.channel_mask = (1u << in.channels) - 1;
+        in.remaining = UINT64_MAX;
+    }
+    else if (analyze_wav_open (&in, input) != 0) {
+        if (in.file) {
+            fclose (in.file);
+        }
+        return 1;
+    }
+    if (in.channels < 1 || in.channels > DDB_FREQ_MAX_CHANNELS || in.samplerate <= 0) {
+        fprintf (stderr, "%s: %d channels at %d Hz are not supported\n", input, in.channels, in.samplerate);
+        fclose (in.file);
+        return 1;
+    }
+
+    FILE *out = fopen (output, o->csv ? "w" : "wb");
+    if (!out) {
+        perror (output);
+        fclose (in.file);
+        return 1;
+    }
+
+    stub_api_init (in.samplerate);
+    deadbeef->conf_set_int ("musical_spectrum.fft_size", o->fft_size);
+    deadbeef->conf_set_int ("musical_spectrum.window", o->window);
+    deadbeef->conf_set_int ("musical_spectrum.draw_style", o->style);
+    config_init ();
+    spectrum_analysis_init ();
+
+    w_spectrum_t *w = stub_widget_new (in.samplerate);
+    const int fft_size = config_get ()->fft_size;
+    const int num_bands = get_num_bars (o->width, in.samplerate);
+    if (spectrum_buffers_reserve (w, num_bands) < 0) {
+        fprintf (stderr, "analyze: out of memory\n");
+        return 1;
+    }
+    create_frequency_table (w->data, in.samplerate, num_bands);
+
+    if (o->csv) {
+        fprintf (out, "frame,time");
+        for (int i = 0; i < num_bands; i++) {
+            fprintf (out, ",%.3f", w->data->frequency[i]);
+        }
+        fprintf (out, "\n");
+    }
+    else {
+        struct analyze_header_t header = {
+            .magic = ANALYZE_MAGIC,
+            .version = ANALYZE_VERSION,
+            .samplerate = in.samplerate,
+            .fft_size = fft_size,
+            .hop = o->hop,
+            .num_bands = num_bands,
+        };
+        fwrite (&header, sizeof (header), 1, out);
+        write_floats (out, w->data->frequency, num_bands);
+    }
+
+    ddb_waveformat_t fmt = {
+        .bps = 32,
+        .channels = in.channels,
+        .samplerate = in.samplerate,
+        .channelmask = in.channel_mask,
+        .is_float = 1,
+    };
+    float *block = malloc ((size_t)o->hop * in.channels * sizeof (float));
+    unsigned char *buffer = malloc ((size_t)o->hop * in.channels * 4);
+    double *db = malloc (num_bands * sizeof (double));
+
+    const double start = now_seconds ();
+    long frames = 0;
+    int n = 0;
+    while ((n = analyze_read (&in, block, o->hop, buffer)) > 0) {
+        // The engine keeps the last fft_size frames of each block only
+        for (int pos = 0; pos < n; pos += fft_size) {
+            ddb_audio_data_t data = {
+                .fmt = &fmt,
+                .data = block + pos * in.channels,
+                .nframes = MIN (fft_size, n - pos),
+            };
+            stub_listener_feed (&data);
+        }
+        spectrum_analysis_get (w->analysis, w->data->spectrum);
+        spectrum_bands_fill (w, num_bands);
+
+        // The levels before the physics and the display range, the bars are
+        // smoothed by gravity and clamped to the range of the settings
+        for (int i = 0; i < num_bands; i++) {
+            db[i] = MAX (w->render->amplitudes[i], DB_FLOOR);
+        }
+        if (o->csv) {
+            fprintf (out, "%ld,%.6f", frames, (double)frames * o->hop / in.samplerate);
+            for (int i = 0; i < num_bands; i++) {
+                fprintf (out, ",%.4f", db[i]);
+            }
+            fprintf (out, "\n");
+        }
+        else {
+            write_floats (out, db, num_bands);
+        }
+        frames++;
+    }
+    const double elapsed = now_seconds () - start;
+    const double duration = (double)frames * o->hop / in.samplerate;
+    fprintf (stderr, "%ld frames with %d bands, %.1f s of audio in %.2f s (%.0fx real time)\n",
+             frames, num_bands, duration, elapsed, elapsed > 0 ? duration / elapsed : 0);
+
+    free (db);
+    free (buffer);
+    free (block);
+    stub_widget_free (w);
+    config_use (NULL);
+    spectrum_analysis_cleanup ();
+    fclose (out);
+    fclose (in.file);
+    return 0;
+}
+
+static FILE *
+compare_open (const char *path, struct analyze_header_t *header)
+{
+    FILE *f = fopen (path, "rb");
+    if (!f) {
+        perror (path);
+        return NULL;
+    }
+    if (fread (header, sizeof (*header), 1, f) != 1 || memcmp (header->magic, ANALYZE_MAGIC, 4)
+        || header->version != ANALYZE_VERSION) {
+        fprintf (stderr, "%s: not a binary analyzer output\n", path);
+        fclose (f);
+        return NULL;
+    }
+    return f;
+}
+
+static int
+compare (const char *reference, const char *result, double tolerance)
+{
+    struct analyze_header_t h_ref;
+    struct analyze_header_t h_res;
+    FILE *f_ref = compare_open (reference, &h_ref);
+    FILE *f_res = f_ref ? compare_open (result, &h_res) : NULL;
+    if (!f_ref || !f_res) {
+        if (f_ref) {
+            fclose (f_ref);
+        }
+        return 2;
+    }
+    if (h_ref.num_bands != h_res.num_bands || h_ref.samplerate != h_res.samplerate
+        || h_ref.fft_size != h_res.fft_size || h_ref.hop != h_res.hop) {
+        fprintf (stderr, "runs differ: %u/%u bands, %u/%u Hz, fft %u/%u, hop %u/%u\n",
+                 h_ref.num_bands, h_res.num_bands, h_ref.samplerate, h_res.samplerate,
+                 h_ref.fft_size, h_res.fft_size, h_ref.hop, h_res.hop);
+        fclose (f_ref);
+        fclose (f_res);
+        return 2;
+    }
+
+    const int num_bands = h_ref.num_bands;
+    float *a = malloc (num_bands * sizeof (float));
+    float *b = malloc (num_bands * sizeof (float));
+    // the frequencies are the first row
+    long frame = -1;
+    long frames = 0;
+    double max_dev = 0;
+    long max_frame = 0;
+    int max_band = 0;
+    double sum_sq = 0;
+    double max_freq_dev = 0;
+    int truncated = 0;
+    for (;;) {
+        const size_t n_a = fread (a, sizeof (float), num_bands, f_ref);
+        const size_t n_b = fread (b, sizeof (float), num_bands, f_res);
+        if (n_a != num_bands || n_b != num_bands) {
+            truncated = n_a != n_b;
+            break;
+        }
+        for (int i = 0; i < num_bands; i++) {
+            const double dev = fabs ((double)a[i] - b[i]);
+            if (frame < 0) {
+                max_freq_dev = MAX (max_freq_dev, dev);
+                continue;
+            }
+            sum_sq += dev * dev;
+            if (dev > max_dev) {
+                max_dev = dev;
+                max_frame = frame;
+                max_band = i;
+            }
+        }
+        if (frame >= 0) {
+            frames++;
+        }
+        frame++;
+    }
+    free (a);
+    free (b);
+    fclose (f_ref);
+    fclose (f_res);
+
+    const double rms = frames > 0 ? sqrt (sum_sq / ((double)frames * num_bands)) : 0;
+    printf ("frames: %ld\nbands: %d\nmax deviation: %.6f dB (frame %ld, band %d)\nrms deviation: %.6f dB\n",
+            frames, num_bands, max_dev, max_frame, max_band, rms);
+    if (max_freq_dev > 0) {
+        printf ("frequency table differs by up to %.6f Hz\n", max_freq_dev);
+    }
+    if (truncated) {
+        printf ("the runs have a different number of frames\n");
+    }
+    return truncated || max_dev > tolerance || max_freq_dev > 0 ? 1 : 0;
+}
+
+static void
+usage (const char *name)
+{
+    fprintf (stderr,
+             "usage: %s [options] input output\n"
+             "       %s -C [-t tolerance] reference.bin result.bin\n"
+             "  -f size     FFT size (default 8192)\n"
+             "  -w window   window function id (default %d)\n"
+             "  -H frames   hop between two frames (default 512)\n"
+             "  -s style    0 musical, 1 solid (default 0)\n"
+             "  -W width    widget width, sets the number of bands of the solid style (default 1000)\n"
+             "  -c          write CSV instead of the binary format\n"
+             "  -r ch:rate  input is raw interleaved 32 bit float with ch channels at rate Hz\n"
+             "  -C          compare two binary runs, exits with 1 if they differ by more than the tolerance\n"
+             "  -t dB       tolerance for -C (default 0)\n",
+             name, name, HANNING_WINDOW);
+}
+
+int
+main (int argc, char **argv)
+{
+    struct analyze_options_t o = {
+        .fft_size = 8192,
+        .window = HANNING_WINDOW,
+        .hop = 512,
+        .style = MUSICAL_STYLE,
+        .width = 1000,
+    };
+    int compare_mode = 0;
+    double tolerance = 0;
+    int opt;
+    while ((opt = getopt (argc, argv, "f:w:H:s:W:cr:Ct:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                o.fft_size = atoi (optarg);
+                break;
+            case 'w':
+                o.window = CLAMP (atoi (optarg), 0, NUM_WINDOW - 1);
+                break;
+            case 'H':
+                o.hop = MAX (atoi (optarg), 1);
+                break;
+            case 's':
+                o.style = CLAMP (atoi (optarg), MUSICAL_STYLE, SOLID_STYLE);
+                break;
+            case 'W':
+                o.width = MAX (atoi (optarg), 1);
+                break;
+            case 'c':
+                o.csv = 1;
+                break;
+            case 'r':
+                o.raw = 1;
+                if (sscanf (optarg, "%d:%d", &o.raw_channels, &o.raw_samplerate) != 2) {
+                    usage (argv[0]);
+                    return 2;
+                }
+                break;
+            case 'C':
+                compare_mode = 1;
+                break;
+            case 't':
+                tolerance = atof (optarg);
+                break;
+            default:
+                usage (argv[0]);
+                return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (argc - optind != 2) {
+        usage (argv[0]);
+        return 2;
+    }
+    if (compare_mode) {
+        return compare (argv[optind], argv[optind + 1], tolerance);
+    }
+    return analyze (&o, argv[optind], argv[optind + 1]);
+}
@@ -0,0 +1,502 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+// Measures the analysis and rendering code outside of DeaDBeeF. The plugin
+// sources are linked against the stub of the player API in stub.c and draw into
+// an image surface, synthetic signals are fed in through the waveform
+// listener. Results are written as JSON, one object per measurement.
+//
+// With -a the frames are not timed but checked for heap allocations, which
+// needs the counter in alloc_count.c to be preloaded. With -r the frames of a
+// recording are drawn instead, so only the physics and drawing are measured.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <gtk/gtk.h>
+
+#include <deadbeef/deadbeef.h>
+#include <deadbeef/gtkui_api.h>
+
+#include "../config.h"
+#include "../spectrum.h"
+#include "../render.h"
+#include "../utils.h"
+#include "../analysis.h"
+#include "../trace.h"
+#include "../replay.h"
+#include "stub.h"
+
+#define SAMPLERATE 44100
+// frames per block handed to the waveform listeners, as the streamer does
+#define BLOCK_FRAMES 512
+
+// Signals
+
+enum bench_signal {
+    SIGNAL_SWEEP,
+    SIGNAL_PINK_NOISE,
+    SIGNAL_CHORD,
+    NUM_SIGNAL,
+    // not generated, the bands come from a recording
+    SIGNAL_REPLAY = NUM_SIGNAL
+};
+
+static const char *signal_names[NUM_SIGNAL + 1] = {"sweep", "pink_noise", "chord", "replay"};
+
+struct bench_generator_t {
+    int signal;
+    long position;
+    double phase;
+    // state of the pink noise filter
+    double b[7];
+    unsigned int seed;
+};
+
+static double
+bench_white_noise (struct bench_generator_t *g)
+{
+    g->seed = g->seed * 1103515245 + 12345;
+    return ((g->seed >> 8) & 0xffff) / 32768.0 - 1;
+}
+
+static double
+bench_sample_get (struct bench_generator_t *g)
+{
+    const double t = (double)g->position / SAMPLERATE;
+    double v = 0;
+    switch (g->signal) {
+        case SIGNAL_SWEEP: {
+            // exponential sweep from 20Hz to 20kHz, repeated every 10 seconds
+            const double period = 10.0;
+            const double f = 20.0 * pow (1000.0, fmod (t, period) / period);
+            g->phase = fmod (g->phase + 2 * M_PI * f / SAMPLERATE, 2 * M_PI);
+            v = 0.5 * sin (g->phase);
+            break;
+        }
+        case SIGNAL_PINK_NOISE: {
+            // Paul Kellet's refined pink noise filter
+            const double white = bench_white_noise (g);
+            double *b = g->b;
+            b[0] = 0.99886 * b[0] + white * 0.0555179;
+            b[1] = 0.99332 * b[1] + white * 0.0750759;
+            b[2] = 0.96900 * b[2] + white * 0.1538520;
+            b[3] = 0.86650 * b[3] + white * 0.3104856;
+            b[4] = 0.55000 * b[4] + white * 0.5329522;
+            b[5] = -0.7616 * b[5] - white * 0.0168980;
+            v = 0.1 * (b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + white * 0.5362);
+            b[6] = white * 0.115926;
+            break;
+        }
+        case SIGNAL_CHORD: {
+            // A minor chord over three octaves
+            static const double freqs[] = {110.0, 220.0, 261.63, 329.63, 440.0, 880.0, 1046.5, 1318.5};
+            const int n = sizeof (freqs) / sizeof (freqs[0]);
+            for (int i = 0; i < n; i++) {
+                v += sin (2 * M_PI * freqs[i] * t);
+            }
+            v *= 0.5 / n;
+            break;
+        }
+    }
+    g->position++;
+    return v;
+}
+
+static void
+bench_block_fill (struct bench_generator_t *g, float *data, int channels, int frames)
+{
+    for (int i = 0; i < frames; i++) {
+        const float v = bench_sample_get (g);
+        for (int ch = 0; ch < channels; ch++) {
+            data[i * channels + ch] = v;
+        }
+    }
+}
+
+// Measurements
+
+struct bench_case_t {
+    int fft_size;
+    int channels;
+    int signal;
+    int style;
+    int width;
+    int height;
+};
+
+static const int fft_sizes[] = {1024, 4096, 8192, 16384, 32768};
+static const int channel_counts[] = {1, 2, 6};
+static const int widget_sizes[][2] = {{300, 100}, {1000, 300}, {2560, 720}};
+static const char *style_names[NUM_STYLE] = {"musical", "solid", "spectrogram"};
+
+static int iterations = 200;
+static int first_result = 1;
+
+static double
+bench_now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+bench_report (FILE *out, const struct bench_case_t *c, const char *stage, double ns)
+{
+    fprintf (out, "%s\n  {\"stage\": \"%s\", \"fft_size\": %d, \"channels\": %d, \"signal\": \"%s\", "
+             "\"style\": \"%s\", \"width\": %d, \"height\": %d, \"iterations\": %d, \"ns_per_frame\": %.0f}",
+             first_result ? "" : ",", stage, c->fft_size, c->channels, signal_names[c->signal],
+             style_names[c->style], c->width, c->height, iterations, ns / iterations);
+    first_result = 0;
+}
+
+static void
+bench_run (FILE *out, const struct bench_case_t *c)
+{
+    deadbeef->conf_set_int ("musical_spectrum.fft_size", c->fft_size);
+    deadbeef->conf_set_int ("musical_spectrum.draw_style", c->style);
+    w_spectrum_t *w = stub_widget_new (SAMPLERATE);
+
+    cairo_surface_t *surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, c->width, c->height);
+    cairo_t *cr = cairo_create (surface);
+
+    ddb_waveformat_t fmt = {
+        .bps = 32,
+        .channels = c->channels,
+        .samplerate = SAMPLERATE,
+        .channelmask = (1 << c->channels) - 1,
+        .is_float = 1,
+    };
+    float *block = malloc (BLOCK_FRAMES * c->channels * sizeof (float));
+    ddb_audio_data_t data = {
+        .fmt = &fmt,
+        .data = block,
+        .nframes = BLOCK_FRAMES,
+    };
+    struct bench_generator_t gen = {
+        .signal = c->signal,
+        .seed = 1,
+    };
+
+    // Fill the sample buffer and let the first frame build the tables
+    for (int i = 0; i < c->fft_size / BLOCK_FRAMES + 1; i++) {
+        bench_block_fill (&gen, block, c->channels, BLOCK_FRAMES);
+        stub_listener_feed (&data);
+    }
+    spectrum_draw_frame (w, cr, c->width, c->height);
+    const int num_bands = w->overlay->ctx.num_bands;
+
+    double t_ingest = 0;
+    double t_fft = 0;
+    double t_bands = 0;
+    double t_frame = 0;
+    for (int i = 0; i < iterations; i++) {
+        bench_block_fill (&gen, block, c->channels, BLOCK_FRAMES);
+
+        double t0 = bench_now ();
+        stub_listener_feed (&data);
+        double t1 = bench_now ();
+        spectrum_analysis_get (w->analysis, w->data->spectrum);
+        double t2 = bench_now ();
+        spectrum_bands_fill (w, num_bands);
+        double t3 = bench_now ();
+        // the spectrum of this block is already computed, the frame only fills
+        // the bands again and draws them
+        spectrum_draw_frame (w, cr, c->width, c->height);
+        double t4 = bench_now ();
+
+        t_ingest += t1 - t0;
+        t_fft += t2 - t1;
+        t_bands += t3 - t2;
+        t_frame += t4 - t3;
+    }
+
+    bench_report (out, c, "ingest", t_ingest);
+    bench_report (out, c, "fft", t_fft);
+    bench_report (out, c, "bands_fill", t_bands);
+    bench_report (out, c, "draw_frame", t_frame);
+
+    free (block);
+    cairo_destroy (cr);
+    cairo_surface_destroy (surface);
+    stub_widget_free (w);
+}
+
+// Draws the records of a recording one after the other, without ingest and FFT
+static void
+bench_replay_run (FILE *out, const struct bench_case_t *c, const char *path)
+{
+    deadbeef->conf_set_int ("musical_spectrum.fft_size", c->fft_size);
+    deadbeef->conf_set_int ("musical_spectrum.draw_style", c->style);
+    deadbeef->conf_set_str ("musical_spectrum.replay_file", path);
+    w_spectrum_t *w = stub_widget_new (SAMPLERATE);
+
+    cairo_surface_t *surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, c->width, c->height);
+    cairo_t *cr = cairo_create (surface);
+
+    // The first frame builds the tables and opens the recording
+    spectrum_draw_frame (w, cr, c->width, c->height);
+    w->replay->stepped = 1;
+    spectrum_replay_seek (w->replay, 0);
+
+    double t_frame = 0;
+    for (int i = 0; i < iterations; i++) {
+        const double t0 = bench_now ();
+        spectrum_draw_frame (w, cr, c->width, c->height);
+        t_frame += bench_now () - t0;
+    }
+    bench_report (out, c, "replay_frame", t_frame);
+
+    cairo_destroy (cr);
+    cairo_surface_destroy (surface);
+    stub_widget_free (w);
+    deadbeef->conf_set_str ("musical_spectrum.replay_file", "");
+}
+
+// Frames drawn before the allocations are counted, the first ones build the tables
+#define WARMUP_FRAMES 20
+
+// Returns the number of allocations in the frames of one case, -1 if
+// the counter isn't preloaded
+static long
+bench_alloc_check (const struct bench_case_t *c)
+{
+    void (*count_start) (void) = dlsym (RTLD_DEFAULT, "alloc_count_start");
+    long (*count_stop) (long *path, long *drawing) = dlsym (RTLD_DEFAULT, "alloc_count_stop");
+    if (!count_start || !count_stop) {
+        return -1;
+    }
+
+    deadbeef->conf_set_int ("musical_spectrum.fft_size", c->fft_size);
+    deadbeef->conf_set_int ("musical_spectrum.draw_style", c->style);
+    w_spectrum_t *w = stub_widget_new (SAMPLERATE);
+
+    cairo_surface_t *surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, c->width, c->height);
+    cairo_t *cr = cairo_create (surface);
+
+    ddb_waveformat_t fmt = {
+        .bps = 32,
+        .channels = c->channels,
+        .samplerate = SAMPLERATE,
+        .channelmask = (1 << c->channels) - 1,
+        .is_float = 1,
+    };
+    float *block = malloc (BLOCK_FRAMES * c->channels * sizeof (float));
+    ddb_audio_data_t data = {
+        .fmt = &fmt,
+        .data = block,
+        .nframes = BLOCK_FRAMES,
+    };
+    struct bench_generator_t gen = {
+        .signal = c->signal,
+        .seed = 1,
+    };
+
+    long allocations = 0;
+    long path = 0;
+    long drawing = 0;
+    for (int i = 0; i < WARMUP_FRAMES + iterations; i++) {
+        if (i == WARMUP_FRAMES) {
+            count_start ();
+        }
+        bench_block_fill (&gen, block, c->channels, BLOCK_FRAMES);
+        stub_listener_feed (&data);
+        spectrum_draw_frame (w, cr, c->width, c->height);
+    }
+    allocations = count_stop (&path, &drawing);
+
+    fprintf (stderr, "%-11s fft %5d: %ld allocations in %d frames (cairo: %ld for paths, %ld in drawing calls)\n",
+             style_names[c->style], c->fft_size, allocations, iterations, path, drawing);
+
+    // A redraw creates the gradient pattern and the static layer, if the
+    // counter doesn't see that it would miss the allocations it's meant to find
+    w->need_redraw = CONFIG_CHANGED_ALL;
+    count_start ();
+    bench_block_fill (&gen, block, c->channels, BLOCK_FRAMES);
+    stub_listener_feed (&data);
+    spectrum_draw_frame (w, cr, c->width, c->height);
+    const long redraw_allocations = count_stop (NULL, NULL);
+    if (redraw_allocations == 0) {
+        fprintf (stderr, "%-11s fft %5d: no allocations counted in a redraw, cairo allocations go unnoticed\n",
+                 style_names[c->style], c->fft_size);
+        allocations = MAX (allocations, 1);
+    }
+
+    free (block);
+    cairo_destroy (cr);
+    cairo_surface_destroy (surface);
+    stub_widget_free (w);
+    return allocations;
+}
+
+static void
+usage (const char *name)
+{
+    fprintf (stderr, "usage: %s [-n iterations] [-o output.json] [-q] [-a] [-r recording]\n", name);
+    fprintf (stderr, "  -q  only the default widget size and stereo\n");
+    fprintf (stderr, "  -r  draw the frames of a recording instead of analysing signals\n");
+    fprintf (stderr, "  -a  fail if a frame allocates, run with LD_PRELOAD=bench/alloc_count.so\n");
+}
+
+int
+main (int argc, char **argv)
+{
+    const char *output = NULL;
+    int quick = 0;
+    int alloc_check = 0;
+    const char *replay = NULL;
+    int opt;
+    while ((opt = getopt (argc, argv, "n:o:qar:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = MAX (atoi (optarg), 1);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'q':
+                quick = 1;
+                break;
+            case 'a':
+                alloc_check = 1;
+                break;
+            case 'r':
+                replay = optarg;
+                break;
+            default:
+                usage (argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (alloc_check) {
+        stub_api_init (SAMPLERATE);
+        config_init ();
+        spectrum_analysis_init ();
+        int res = 0;
+        for (int f = 0; f < sizeof (fft_sizes) / sizeof (fft_sizes[0]) && res != 2; f++) {
+            for (int style = 0; style < NUM_STYLE && res != 2; style++) {
+                struct bench_case_t c = {
+                    .fft_size = fft_sizes[f],
+                    .channels = 2,
+                    .signal = SIGNAL_PINK_NOISE,
+                    .style = style,
+                    .width = widget_sizes[1][0],
+                    .height = widget_sizes[1][1],
+                };
+                const long allocations = bench_alloc_check (&c);
+                if (allocations < 0) {
+                    fprintf (stderr, "the allocation counter is missing, run with LD_PRELOAD=bench/alloc_count.so\n");
+                    res = 2;
+                }
+                else if (allocations > 0) {
+                    res = 1;
+                }
+            }
+        }
+        config_use (NULL);
+        spectrum_analysis_cleanup ();
+        return res;
+    }
+
+    // The bands are sized for the FFT size of the recording
+    int replay_fft_size = 0;
+    if (replay) {
+        struct spectrum_replay_t *r = spectrum_replay_new (replay);
+        replay_fft_size = r && r->header ? r->header->fft_size : 0;
+        spectrum_replay_free (r);
+        if (!replay_fft_size) {
+            return 1;
+        }
+    }
+
+    FILE *out = stdout;
+    if (output) {
+        out = fopen (output, "w");
+        if (!out) {
+            perror (output);
+            return 1;
+        }
+    }
+
+    stub_api_init (SAMPLERATE);
+    config_init ();
+    spectrum_trace_init ();
+    spectrum_analysis_init ();
+
+    const int num_sizes = quick ? 1 : sizeof (widget_sizes) / sizeof (widget_sizes[0]);
+    const int num_channel_counts = quick ? 1 : sizeof (channel_counts) / sizeof (channel_counts[0]);
+
+    fprintf (out, "[");
+    if (replay) {
+        for (int style = 0; style < NUM_STYLE; style++) {
+            for (int s = 0; s < num_sizes; s++) {
+                const int size = quick ? 1 : s;
+                struct bench_case_t c = {
+                    .fft_size = replay_fft_size,
+                    .channels = 2,
+                    .signal = SIGNAL_REPLAY,
+                    .style = style,
+                    .width = widget_sizes[size][0],
+                    .height = widget_sizes[size][1],
+                };
+                fprintf (stderr, "%s, %s, %dx%d\n", replay, style_names[c.style], c.width, c.height);
+                bench_replay_run (out, &c, replay);
+            }
+        }
+    }
+    else {
+        for (int f = 0; f < sizeof (fft_sizes) / sizeof (fft_sizes[0]); f++) {
+            for (int ch = 0; ch < num_channel_counts; ch++) {
+                for (int sig = 0; sig < NUM_SIGNAL; sig++) {
+                    for (int style = 0; style < NUM_STYLE; style++) {
+                        for (int s = 0; s < num_sizes; s++) {
+                            const int size = quick ? 1 : s;
+                            struct bench_case_t c = {
+                                .fft_size = fft_sizes[f],
+                                .channels = quick ? 2 : channel_counts[ch],
+                                .signal = sig,
+                                .style = style,
+                                .width = widget_sizes[size][0],
+                                .height = widget_sizes[size][1],
+                            };
+                            fprintf (stderr, "fft %d, %d channels, %s, %s, %dx%d\n", c.fft_size, c.channels,
+                                     signal_names[c.signal], style_names[c.style], c.width, c.height);
+                            bench_run (out, &c);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    fprintf (out, "\n]\n");
+
+    config_use (NULL);
+    spectrum_analysis_cleanup ();
+    spectrum_trace_cleanup ();
+    if (out != stdout) {
+        fclose (out);
+    }
+    return 0;
+}
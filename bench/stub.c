@@ -0,0 +1,352 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+// Minimal implementation of the player API for running the plugin code
+// outside of DeaDBeeF, shared by the benchmark and the analyzer
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <gtk/gtk.h>
+
+#include <deadbeef/deadbeef.h>
+#include <deadbeef/gtkui_api.h>
+
+#include "../config.h"
+#include "../spectrum.h"
+#include "../render.h"
+#include "../utils.h"
+#include "../analysis.h"
+#include "../arena.h"
+#include "../shm.h"
+#include "../stream.h"
+#include "../api.h"
+#include "../recorder.h"
+#include "../replay.h"
+#include "stub.h"
+
+DB_functions_t *deadbeef = NULL;
+ddb_gtkui_t *gtkui_plugin = NULL;
+
+static DB_functions_t stub_api;
+static DB_output_t stub_output;
+
+static void *listener_ctx = NULL;
+static void (*listener) (void *ctx, ddb_audio_data_t *data) = NULL;
+
+// Config values set with conf_set_int and conf_set_str, everything else has
+// its default. Like in DeaDBeeF all values are stored as strings.
+#define MAX_CONF_VALUES 64
+
+struct stub_conf_value_t {
+    char key[100];
+    char *val;
+};
+
+static struct stub_conf_value_t conf_values[MAX_CONF_VALUES];
+static int num_conf_values = 0;
+
+static uintptr_t
+stub_mutex_create (void)
+{
+    pthread_mutex_t *mtx = malloc (sizeof (pthread_mutex_t));
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init (&attr);
+    pthread_mutexattr_settype (&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init (mtx, &attr);
+    pthread_mutexattr_destroy (&attr);
+    return (uintptr_t)mtx;
+}
+
+static void
+stub_mutex_free (uintptr_t mtx)
+{
+    pthread_mutex_destroy ((pthread_mutex_t *)mtx);
+    free ((void *)mtx);
+}
+
+static int
+stub_mutex_lock (uintptr_t mtx)
+{
+    return pthread_mutex_lock ((pthread_mutex_t *)mtx);
+}
+
+static int
+stub_mutex_unlock (uintptr_t mtx)
+{
+    return pthread_mutex_unlock ((pthread_mutex_t *)mtx);
+}
+
+static uintptr_t
+stub_cond_create (void)
+{
+    pthread_cond_t *cond = malloc (sizeof (pthread_cond_t));
+    pthread_cond_init (cond, NULL);
+    return (uintptr_t)cond;
+}
+
+static void
+stub_cond_free (uintptr_t cond)
+{
+    pthread_cond_destroy ((pthread_cond_t *)cond);
+    free ((void *)cond);
+}
+
+static int
+stub_cond_wait (uintptr_t cond, uintptr_t mutex)
+{
+    return pthread_cond_wait ((pthread_cond_t *)cond, (pthread_mutex_t *)mutex);
+}
+
+static int
+stub_cond_signal (uintptr_t cond)
+{
+    return pthread_cond_signal ((pthread_cond_t *)cond);
+}
+
+static int
+stub_cond_broadcast (uintptr_t cond)
+{
+    return pthread_cond_broadcast ((pthread_cond_t *)cond);
+}
+
+struct stub_thread_t {
+    void (*fn) (void *ctx);
+    void *ctx;
+};
+
+static void *
+stub_thread_func (void *data)
+{
+    struct stub_thread_t t = *(struct stub_thread_t *)data;
+    free (data);
+    t.fn (t.ctx);
+    return NULL;
+}
+
+static intptr_t
+stub_thread_start (void (*fn) (void *ctx), void *ctx)
+{
+    struct stub_thread_t *t = malloc (sizeof (struct stub_thread_t));
+    t->fn = fn;
+    t->ctx = ctx;
+    pthread_t tid;
+    if (pthread_create (&tid, NULL, stub_thread_func, t) != 0) {
+        free (t);
+        return 0;
+    }
+    return (intptr_t)tid;
+}
+
+static int
+stub_thread_join (intptr_t tid)
+{
+    return pthread_join ((pthread_t)tid, NULL);
+}
+
+static int
+stub_conf_get_int (const char *key, int def)
+{
+    for (int i = 0; i < num_conf_values; i++) {
+        if (!strcmp (conf_values[i].key, key)) {
+            return atoi (conf_values[i].val);
+        }
+    }
+    return def;
+}
+
+static const char *
+stub_conf_get_str_fast (const char *key, const char *def)
+{
+    for (int i = 0; i < num_conf_values; i++) {
+        if (!strcmp (conf_values[i].key, key)) {
+            return conf_values[i].val;
+        }
+    }
+    return def;
+}
+
+static struct stub_conf_value_t *
+stub_conf_value_get (const char *key)
+{
+    int i = 0;
+    while (i < num_conf_values && strcmp (conf_values[i].key, key)) {
+        i++;
+    }
+    if (i == MAX_CONF_VALUES) {
+        return NULL;
+    }
+    if (i == num_conf_values) {
+        snprintf (conf_values[i].key, sizeof (conf_values[i].key), "%s", key);
+        num_conf_values++;
+    }
+    return &conf_values[i];
+}
+
+static void
+stub_conf_set_str (const char *key, const char *val)
+{
+    struct stub_conf_value_t *v = stub_conf_value_get (key);
+    if (v) {
+        g_free (v->val);
+        v->val = g_strdup (val);
+    }
+}
+
+static void
+stub_conf_set_int (const char *key, int val)
+{
+    char str[32];
+    snprintf (str, sizeof (str), "%d", val);
+    stub_conf_set_str (key, str);
+}
+
+static void
+stub_conf_lock (void)
+{
+}
+
+static void
+stub_conf_unlock (void)
+{
+}
+
+#if (DDB_API_LEVEL >= 11)
+static ddb_playback_state_t
+#else
+static int
+#endif
+stub_output_state (void)
+{
+    return OUTPUT_STATE_PLAYING;
+}
+
+static DB_output_t *
+stub_get_output (void)
+{
+    return &stub_output;
+}
+
+static void
+stub_vis_waveform_listen (void *ctx, void (*callback) (void *ctx, ddb_audio_data_t *data))
+{
+    listener_ctx = ctx;
+    listener = callback;
+}
+
+static void
+stub_vis_waveform_unlisten (void *ctx)
+{
+    if (listener_ctx == ctx) {
+        listener_ctx = NULL;
+        listener = NULL;
+    }
+}
+
+void
+stub_api_init (int samplerate)
+{
+    stub_output.fmt.samplerate = samplerate;
+    stub_output.state = stub_output_state;
+
+    stub_api.mutex_create = stub_mutex_create;
+    stub_api.mutex_free = stub_mutex_free;
+    stub_api.mutex_lock = stub_mutex_lock;
+    stub_api.mutex_unlock = stub_mutex_unlock;
+    stub_api.cond_create = stub_cond_create;
+    stub_api.cond_free = stub_cond_free;
+    stub_api.cond_wait = stub_cond_wait;
+    stub_api.cond_signal = stub_cond_signal;
+    stub_api.cond_broadcast = stub_cond_broadcast;
+    stub_api.thread_start = stub_thread_start;
+    stub_api.thread_join = stub_thread_join;
+    stub_api.conf_get_int = stub_conf_get_int;
+    stub_api.conf_get_str_fast = stub_conf_get_str_fast;
+    stub_api.conf_set_int = stub_conf_set_int;
+    stub_api.conf_set_str = stub_conf_set_str;
+    stub_api.conf_lock = stub_conf_lock;
+    stub_api.conf_unlock = stub_conf_unlock;
+    stub_api.get_output = stub_get_output;
+    stub_api.vis_waveform_listen = stub_vis_waveform_listen;
+    stub_api.vis_waveform_unlisten = stub_vis_waveform_unlisten;
+    deadbeef = &stub_api;
+}
+
+void
+stub_listener_feed (ddb_audio_data_t *data)
+{
+    if (listener) {
+        listener (listener_ctx, data);
+    }
+}
+
+w_spectrum_t *
+stub_widget_new (int samplerate)
+{
+    w_spectrum_t *w = calloc (1, sizeof (w_spectrum_t));
+    w->config = config_store_new (0);
+    config_use (w->config);
+    config_apply ();
+
+    struct spectrum_analysis_params_t params = spectrum_analysis_params_get ();
+    w->analysis = spectrum_analysis_acquire (&params);
+    w->data = spectrum_data_new ();
+    w->render = spectrum_render_new ();
+    w->arena = spectrum_arena_new ();
+    w->overlay = spectrum_overlay_new ();
+    w->samplerate = samplerate;
+    w->playback_status = PLAYING;
+    w->need_redraw = CONFIG_CHANGED_ALL;
+    w->prev_width = -1;
+    w->prev_height = -1;
+    update_gravity (w->render, config_get_int (ID_REFRESH_INTERVAL));
+    spectrum_analysis_listen (w->analysis);
+    spectrum_analysis_wait (w->analysis);
+    return w;
+}
+
+void
+stub_widget_free (w_spectrum_t *w)
+{
+    spectrum_analysis_unlisten (w->analysis);
+    spectrum_analysis_release (w->analysis);
+    w->analysis = NULL;
+    spectrum_overlay_free (w->overlay);
+    w->overlay = NULL;
+    spectrum_shm_writer_free (w->shm);
+    w->shm = NULL;
+    spectrum_stream_free (w->stream);
+    w->stream = NULL;
+    spectrum_api_publisher_free (w->publisher);
+    w->publisher = NULL;
+    spectrum_recorder_free (w->recorder);
+    w->recorder = NULL;
+    spectrum_replay_free (w->replay);
+    w->replay = NULL;
+    spectrum_render_free (w->render);
+    w->render = NULL;
+    spectrum_data_free (w->data);
+    w->data = NULL;
+    spectrum_arena_free (w->arena);
+    w->arena = NULL;
+    config_store_free (w->config);
+    w->config = NULL;
+    free (w);
+}
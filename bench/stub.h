@@ -0,0 +1,40 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#pragma once
+
+#include <deadbeef/deadbeef.h>
+#include "../spectrum.h"
+
+// Points deadbeef to the stub, the output reports playback at the given samplerate
+void
+stub_api_init (int samplerate);
+
+// Hands a block of samples to the waveform listener, if one is registered
+void
+stub_listener_feed (ddb_audio_data_t *data);
+
+// Widget without GTK parts, using instance 0 of the config. It listens to
+// the waveform, its frequency table is built by the first frame or
+// create_frequency_table
+w_spectrum_t *
+stub_widget_new (int samplerate);
+
+void
+stub_widget_free (w_spectrum_t *w);
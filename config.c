@@ -37,62 +37,150 @@
 #define CONFIG_COLOR_FORMAT_SHORT "%hd %hd %hd"
 
 struct spectrum_config_int_t spectrum_config_int[NUM_ID_INT] = {
-    [ID_REFRESH_INTERVAL] =     {"refresh_interval",     0, 25},
-    [ID_INTERPOLATE] =          {"interpolate",          0, 1},
-    [ID_CHANNEL] =              {"channel",              0, 262143},
-    [ID_TRANSPOSE] =            {"transpose",            0, 0},
-    [ID_PITCH] =                {"pitch",                0, 440},
-    [ID_NOTE_MIN] =             {"note_min",             0, 0},
-    [ID_NOTE_MAX] =             {"note_max",             0, 125},
-    [ID_AMPLITUDE_MIN] =        {"amp_min",              0, -60},
-    [ID_AMPLITUDE_MAX] =        {"amp_max",              0, 0},
-    [ID_ENABLE_PEAKS] =         {"enable_peaks",         0, TRUE},
-    [ID_ENABLE_PEAKS_COLOR] =   {"enable_peaks_color",   0, FALSE},
-    [ID_ENABLE_AMPLITUDES] =    {"enable_amp",           0, FALSE},
-    [ID_ENABLE_TOP_LABELS] =    {"enable_top_labels",    0, FALSE},
-    [ID_ENABLE_BOTTOM_LABELS] = {"enable_bottom_labels", 0, TRUE},
-    [ID_ENABLE_LEFT_LABELS] =   {"enable_left_labels",   0, TRUE},
-    [ID_ENABLE_RIGHT_LABELS] =  {"enable_right_labels",  0, TRUE},
-    [ID_ENABLE_HGRID] =         {"enable_hgrid",         0, TRUE},
-    [ID_ENABLE_VGRID] =         {"enable_vgrid",         0, TRUE},
-    [ID_ENABLE_OGRID] =         {"enable_ogrid",         0, FALSE},
-    [ID_ENABLE_WHITE_KEYS] =    {"enable_white_keys",    0, TRUE},
-    [ID_ENABLE_BLACK_KEYS] =    {"enable_black_keys",    0, FALSE},
-    [ID_ENABLE_TOOLTIP] =       {"enable_tooltip",       0, TRUE},
-    [ID_ALIGNMENT] =            {"alignment",            0, CENTER_ALIGN},
-    [ID_ENABLE_BAR_MODE] =      {"enable_bar_mode",      0, FALSE},
-    [ID_BAR_FALLOFF] =          {"bar_falloff",          0, 100},
-    [ID_BAR_DELAY] =            {"bar_delay",            0, 100},
-    [ID_PEAK_FALLOFF] =         {"peak_falloff",         0, 50},
-    [ID_PEAK_DELAY] =           {"peak_delay",           0, 500},
-    [ID_GRADIENT_ORIENTATION] = {"gradient_orientation", 0, VERTICAL_ORIENTATION},
-    [ID_NUM_COLORS] =           {"num_colors",           0, 6},
-    [ID_FFT_SIZE] =             {"fft_size",             0, 8192},
-    [ID_WINDOW] =               {"window",               0, HANNING_WINDOW},
-    [ID_BAR_W] =                {"bar_w",                0, 0},
-    [ID_GAPS] =                 {"gaps",                 0, 1},
-    [ID_SPACING] =              {"spacing",              0, 1},
-    [ID_DRAW_STYLE] =           {"draw_style",           0, MUSICAL_STYLE},
-    [ID_FILL_SPECTRUM] =        {"fill_spectrum",        0, 1},
+    [ID_REFRESH_INTERVAL] =     {"refresh_interval",     25},
+    [ID_INTERPOLATE] =          {"interpolate",          1},
+    [ID_CHANNEL] =              {"channel",              262143},
+    [ID_TRANSPOSE] =            {"transpose",            0},
+    [ID_PITCH] =                {"pitch",                440},
+    [ID_NOTE_MIN] =             {"note_min",             0},
+    [ID_NOTE_MAX] =             {"note_max",             125},
+    [ID_AMPLITUDE_MIN] =        {"amp_min",              -60},
+    [ID_AMPLITUDE_MAX] =        {"amp_max",              0},
+    [ID_ENABLE_PEAKS] =         {"enable_peaks",         TRUE},
+    [ID_ENABLE_PEAKS_COLOR] =   {"enable_peaks_color",   FALSE},
+    [ID_ENABLE_AMPLITUDES] =    {"enable_amp",           FALSE},
+    [ID_ENABLE_TOP_LABELS] =    {"enable_top_labels",    FALSE},
+    [ID_ENABLE_BOTTOM_LABELS] = {"enable_bottom_labels", TRUE},
+    [ID_ENABLE_LEFT_LABELS] =   {"enable_left_labels",   TRUE},
+    [ID_ENABLE_RIGHT_LABELS] =  {"enable_right_labels",  TRUE},
+    [ID_ENABLE_HGRID] =         {"enable_hgrid",         TRUE},
+    [ID_ENABLE_VGRID] =         {"enable_vgrid",         TRUE},
+    [ID_ENABLE_OGRID] =         {"enable_ogrid",         FALSE},
+    [ID_ENABLE_WHITE_KEYS] =    {"enable_white_keys",    TRUE},
+    [ID_ENABLE_BLACK_KEYS] =    {"enable_black_keys",    FALSE},
+    [ID_ENABLE_TOOLTIP] =       {"enable_tooltip",       TRUE},
+    [ID_ALIGNMENT] =            {"alignment",            CENTER_ALIGN},
+    [ID_ENABLE_BAR_MODE] =      {"enable_bar_mode",      FALSE},
+    [ID_BAR_FALLOFF] =          {"bar_falloff",          100},
+    [ID_BAR_DELAY] =            {"bar_delay",            100},
+    [ID_PEAK_FALLOFF] =         {"peak_falloff",         50},
+    [ID_PEAK_DELAY] =           {"peak_delay",           500},
+    [ID_GRADIENT_ORIENTATION] = {"gradient_orientation", VERTICAL_ORIENTATION},
+    [ID_NUM_COLORS] =           {"num_colors",           6},
+    [ID_FFT_SIZE] =             {"fft_size",             8192},
+    [ID_WINDOW] =               {"window",               HANNING_WINDOW},
+    [ID_BAR_W] =                {"bar_w",                0},
+    [ID_GAPS] =                 {"gaps",                 1},
+    [ID_SPACING] =              {"spacing",              1},
+    [ID_DRAW_STYLE] =           {"draw_style",           MUSICAL_STYLE},
+    [ID_FILL_SPECTRUM] =        {"fill_spectrum",        1},
+    [ID_FRAME_DIVISOR] =        {"frame_divisor",        0},
+    [ID_ADAPTIVE_REFRESH] =     {"adaptive_refresh",     FALSE},
+    [ID_REFRESH_INTERVAL_MAX] = {"refresh_interval_max", 100},
+    [ID_CPU_BUDGET] =           {"cpu_budget",           5},
+    [ID_SPECTROGRAM_HISTORY] =  {"spectrogram_history",  0},
+    [ID_SHARED_MEMORY] =        {"shared_memory",        FALSE},
+    [ID_SOCKET_STREAM] =        {"socket_stream",        0},
 };
 
 struct spectrum_config_color_t spectrum_config_color[NUM_ID_COLOR] = {
-    [ID_COLOR_BG] =         { "background", {0}, {.red = 0,     .green = 0,     .blue = 0}},
-    [ID_COLOR_TEXT] =       { "text",       {0}, {.red = 65535, .green = 65535, .blue = 65535}},
-    [ID_COLOR_VGRID] =      { "vgrid",      {0}, {.red = 21845, .green = 21845, .blue = 21845}},
-    [ID_COLOR_HGRID] =      { "hgrid",      {0}, {.red = 21845, .green = 21845, .blue = 21845}},
-    [ID_COLOR_OGRID] =      { "ogrid",      {0}, {.red = 42148, .green = 0,     .blue = 0}},
-    [ID_COLOR_BLACK_KEYS] = { "black_keys", {0}, {.red = 0,     .green = 0,     .blue = 0}},
-    [ID_COLOR_WHITE_KEYS] = { "white_keys", {0}, {.red = 10240, .green = 10240, .blue = 10240}},
-    [ID_COLOR_PEAKS] =      { "peaks",      {0}, {.red = 42148, .green = 0,     .blue = 0}},
+    [ID_COLOR_BG] =         { "background", {.red = 0,     .green = 0,     .blue = 0}},
+    [ID_COLOR_TEXT] =       { "text",       {.red = 65535, .green = 65535, .blue = 65535}},
+    [ID_COLOR_VGRID] =      { "vgrid",      {.red = 21845, .green = 21845, .blue = 21845}},
+    [ID_COLOR_HGRID] =      { "hgrid",      {.red = 21845, .green = 21845, .blue = 21845}},
+    [ID_COLOR_OGRID] =      { "ogrid",      {.red = 42148, .green = 0,     .blue = 0}},
+    [ID_COLOR_BLACK_KEYS] = { "black_keys", {.red = 0,     .green = 0,     .blue = 0}},
+    [ID_COLOR_WHITE_KEYS] = { "white_keys", {.red = 10240, .green = 10240, .blue = 10240}},
+    [ID_COLOR_PEAKS] =      { "peaks",      {.red = 42148, .green = 0,     .blue = 0}},
 };
 
 struct spectrum_config_string_t spectrum_config_string[NUM_ID_STRING] = {
-    [ID_STRING_FONT] = {"font", NULL, "Sans 7"},
-    [ID_STRING_FONT_TOOLTIP] = {"font_tooltip", NULL, "Sans 9"},
+    [ID_STRING_FONT] = {"font", "Sans 7"},
+    [ID_STRING_FONT_TOOLTIP] = {"font_tooltip", "Sans 9"},
+    [ID_STRING_RECORD_FILE] = {"record_file", ""},
+    [ID_STRING_REPLAY_FILE] = {"replay_file", ""},
 };
 
-GList *CONFIG_GRADIENT_COLORS = NULL;
+// Parts of the widget which have to be rebuilt when a setting changes,
+// settings which are only read while drawing a frame are CONFIG_CHANGED_OTHER
+#define CHANGED_LAYOUT (CONFIG_CHANGED_BANDS | CONFIG_CHANGED_STATIC)
+
+static const unsigned int config_int_changes[NUM_ID_INT] = {
+    [ID_REFRESH_INTERVAL] =     CONFIG_CHANGED_TIMING,
+    [ID_INTERPOLATE] =          CONFIG_CHANGED_OTHER,
+    [ID_CHANNEL] =              CONFIG_CHANGED_ANALYSIS,
+    [ID_TRANSPOSE] =            CONFIG_CHANGED_BANDS,
+    [ID_PITCH] =                CONFIG_CHANGED_BANDS,
+    [ID_NOTE_MIN] =             CHANGED_LAYOUT,
+    [ID_NOTE_MAX] =             CHANGED_LAYOUT,
+    [ID_AMPLITUDE_MIN] =        CONFIG_CHANGED_STATIC,
+    [ID_AMPLITUDE_MAX] =        CONFIG_CHANGED_STATIC,
+    [ID_ENABLE_PEAKS] =         CONFIG_CHANGED_OTHER,
+    [ID_ENABLE_PEAKS_COLOR] =   CONFIG_CHANGED_OTHER,
+    [ID_ENABLE_AMPLITUDES] =    CONFIG_CHANGED_OTHER,
+    [ID_ENABLE_TOP_LABELS] =    CHANGED_LAYOUT,
+    [ID_ENABLE_BOTTOM_LABELS] = CHANGED_LAYOUT,
+    [ID_ENABLE_LEFT_LABELS] =   CHANGED_LAYOUT,
+    [ID_ENABLE_RIGHT_LABELS] =  CHANGED_LAYOUT,
+    [ID_ENABLE_HGRID] =         CONFIG_CHANGED_STATIC,
+    [ID_ENABLE_VGRID] =         CONFIG_CHANGED_STATIC,
+    [ID_ENABLE_OGRID] =         CONFIG_CHANGED_OTHER,
+    [ID_ENABLE_WHITE_KEYS] =    CONFIG_CHANGED_STATIC,
+    [ID_ENABLE_BLACK_KEYS] =    CONFIG_CHANGED_STATIC,
+    [ID_ENABLE_TOOLTIP] =       CONFIG_CHANGED_OTHER,
+    [ID_ALIGNMENT] =            CONFIG_CHANGED_STATIC,
+    [ID_ENABLE_BAR_MODE] =      CONFIG_CHANGED_OTHER,
+    [ID_BAR_FALLOFF] =          CONFIG_CHANGED_TIMING,
+    [ID_BAR_DELAY] =            CONFIG_CHANGED_TIMING,
+    [ID_PEAK_FALLOFF] =         CONFIG_CHANGED_TIMING,
+    [ID_PEAK_DELAY] =           CONFIG_CHANGED_TIMING,
+    [ID_GRADIENT_ORIENTATION] = CONFIG_CHANGED_COLORS,
+    [ID_NUM_COLORS] =           CONFIG_CHANGED_COLORS,
+    [ID_FFT_SIZE] =             CONFIG_CHANGED_ANALYSIS | CHANGED_LAYOUT,
+    [ID_WINDOW] =               CONFIG_CHANGED_ANALYSIS,
+    // the band width decides where keys, grid and labels go
+    [ID_BAR_W] =                CONFIG_CHANGED_STATIC,
+    [ID_GAPS] =                 CONFIG_CHANGED_OTHER,
+    [ID_SPACING] =              CONFIG_CHANGED_OTHER,
+    [ID_DRAW_STYLE] =           CHANGED_LAYOUT,
+    [ID_FILL_SPECTRUM] =        CONFIG_CHANGED_OTHER,
+    [ID_FRAME_DIVISOR] =        CONFIG_CHANGED_TIMING,
+    [ID_ADAPTIVE_REFRESH] =     CONFIG_CHANGED_TIMING,
+    [ID_REFRESH_INTERVAL_MAX] = CONFIG_CHANGED_TIMING,
+    [ID_CPU_BUDGET] =           CONFIG_CHANGED_TIMING,
+    [ID_SPECTROGRAM_HISTORY] =  CONFIG_CHANGED_OTHER,
+    [ID_SHARED_MEMORY] =        CONFIG_CHANGED_OTHER,
+    [ID_SOCKET_STREAM] =        CONFIG_CHANGED_OTHER,
+};
+
+static const unsigned int config_color_changes[NUM_ID_COLOR] = {
+    [ID_COLOR_BG] =         CONFIG_CHANGED_STATIC | CONFIG_CHANGED_COLORS,
+    [ID_COLOR_TEXT] =       CONFIG_CHANGED_STATIC,
+    [ID_COLOR_VGRID] =      CONFIG_CHANGED_STATIC,
+    [ID_COLOR_HGRID] =      CONFIG_CHANGED_STATIC,
+    [ID_COLOR_OGRID] =      CONFIG_CHANGED_OTHER,
+    [ID_COLOR_BLACK_KEYS] = CONFIG_CHANGED_STATIC,
+    [ID_COLOR_WHITE_KEYS] = CONFIG_CHANGED_STATIC,
+    [ID_COLOR_PEAKS] =      CONFIG_CHANGED_OTHER,
+};
+
+static const unsigned int config_string_changes[NUM_ID_STRING] = {
+    // the size of the labels depends on the font
+    [ID_STRING_FONT] =         CHANGED_LAYOUT,
+    [ID_STRING_FONT_TOOLTIP] = CONFIG_CHANGED_OTHER,
+    [ID_STRING_RECORD_FILE] =  CONFIG_CHANGED_OTHER,
+    // replays don't listen to the audio
+    [ID_STRING_REPLAY_FILE] =  CONFIG_CHANGED_ANALYSIS,
+};
+
+// Used by threads which didn't select a store yet
+static struct spectrum_config_t config_fallback;
+// Snapshot pinned by the calling thread and the store it belongs to
+static __thread struct spectrum_config_t *config_current = &config_fallback;
+static __thread struct spectrum_config_store_t *config_store_current = NULL;
+// Generations are unique across all stores, a snapshot can't be mistaken for
+// the current one of a store which got allocated at the address of a freed one
+static uint64_t config_generation = 0;
 
 static GdkColor
 color_from_string (const char *color_string)
@@ -109,100 +197,142 @@ string_from_color (const GdkColor *color, char *dest, size_t dest_size)
 }
 
 static void
-config_save_int (const int index)
+config_key (char *dest, size_t dest_size, int instance, const char *name)
+{
+    if (instance > 0) {
+        snprintf (dest, dest_size, CONFIG_PREFIX ".%d.%s", instance, name);
+    }
+    else {
+        snprintf (dest, dest_size, CONFIG_PREFIX ".%s", name);
+    }
+}
+
+static void
+config_save_int (struct spectrum_config_t *c, int instance, const int index)
 {
     char config_name[200] = {};
-    snprintf (config_name, sizeof (config_name), CONFIG_PREFIX ".%s", spectrum_config_int[index].name);
-    deadbeef->conf_set_int (config_name, spectrum_config_int[index].val);
+    config_key (config_name, sizeof (config_name), instance, spectrum_config_int[index].name);
+    deadbeef->conf_set_int (config_name, c->ints[index]);
 }
 
 static void
-config_save_color (const int index)
+config_save_color (struct spectrum_config_t *c, int instance, const int index)
 {
+    char name[100] = {};
+    snprintf (name, sizeof (name), "color.%s", spectrum_config_color[index].name);
     char config_name[200] = {};
-    snprintf (config_name, sizeof (config_name), CONFIG_PREFIX ".color.%s", spectrum_config_color[index].name);
+    config_key (config_name, sizeof (config_name), instance, name);
 
-    GdkColor *color = &spectrum_config_color[index].val;
+    GdkColor *color = &c->colors[index];
     char color_formated[100] = {};
     string_from_color (color, color_formated, sizeof (color_formated));
     deadbeef->conf_set_str (config_name, color_formated);
 }
 
 static void
-config_save_string (const int index)
+config_save_string (struct spectrum_config_t *c, int instance, const int index)
 {
     char config_name[200] = {};
-    snprintf (config_name, sizeof (config_name), CONFIG_PREFIX ".%s", spectrum_config_string[index].name);
-    deadbeef->conf_set_str (config_name, spectrum_config_string[index].val);
+    config_key (config_name, sizeof (config_name), instance, spectrum_config_string[index].name);
+    deadbeef->conf_set_str (config_name, c->strings[index]);
 }
 
-void
-save_config (void)
+// Settings of additional instances default to the ones of the first instance
+static const char *
+config_load_str (int instance, const char *name, const char *def)
 {
-    for (int i = 0; i < NUM_ID_INT; i++) {
-        config_save_int (i);
-    }
-    for (int i = 0; i < NUM_ID_STRING; i++) {
-        config_save_string (i);
-    }
-    for (int i = 0; i < NUM_ID_COLOR; i++) {
-        config_save_color (i);
-    }
-
-    // Gradient colors
-    char color[100] = {};
-    char conf_str[100] = {};
-    GList *c = CONFIG_GRADIENT_COLORS;
-    for (int i = 0; c != NULL; c = c->next, i++) {
-        GdkColor *clr = c->data;
-        snprintf (color, sizeof (color), CONFIG_COLOR_FORMAT, clr->red, clr->green, clr->blue);
-        snprintf (conf_str, sizeof (conf_str), "%s%02d", CONFIG_PREFIX ".color.gradient_", i);
-        deadbeef->conf_set_str (conf_str, color);
+    char config_name[200] = {};
+    config_key (config_name, sizeof (config_name), 0, name);
+    def = deadbeef->conf_get_str_fast (config_name, def);
+    if (instance > 0) {
+        config_key (config_name, sizeof (config_name), instance, name);
+        def = deadbeef->conf_get_str_fast (config_name, def);
     }
+    return def;
 }
 
 static void
-config_load_color (const int index)
+config_load_color (struct spectrum_config_t *c, int instance, const int index)
 {
-    char config_name[200] = {};
-    snprintf (config_name, sizeof (config_name), CONFIG_PREFIX ".color.%s", spectrum_config_color[index].name);
+    char name[100] = {};
+    snprintf (name, sizeof (name), "color.%s", spectrum_config_color[index].name);
 
     char color_def_string[100] = {};
     GdkColor clr = spectrum_config_color[index].val_def;
     string_from_color (&clr, color_def_string, sizeof (color_def_string));
 
-    const char *color_string = deadbeef->conf_get_str_fast (config_name, color_def_string);
-    spectrum_config_color[index].val = color_from_string (color_string);
+    const char *color_string = config_load_str (instance, name, color_def_string);
+    c->colors[index] = color_from_string (color_string);
 }
 
 static void
-config_load_int (const int index)
+config_load_int (struct spectrum_config_t *c, int instance, const int index)
 {
     char config_name[200] = {};
-    snprintf (config_name, sizeof (config_name), CONFIG_PREFIX ".%s", spectrum_config_int[index].name);
-    spectrum_config_int[index].val = deadbeef->conf_get_int (config_name, spectrum_config_int[index].val_def);
+    config_key (config_name, sizeof (config_name), 0, spectrum_config_int[index].name);
+    int val = deadbeef->conf_get_int (config_name, spectrum_config_int[index].val_def);
+    if (instance > 0) {
+        config_key (config_name, sizeof (config_name), instance, spectrum_config_int[index].name);
+        val = deadbeef->conf_get_int (config_name, val);
+    }
+    c->ints[index] = val;
 }
 
 static void
-config_load_string (const int index)
+config_load_string (struct spectrum_config_t *c, int instance, const int index)
 {
-    char config_name[200] = {};
-    snprintf (config_name, sizeof (config_name), CONFIG_PREFIX ".%s", spectrum_config_string[index].name);
-    spectrum_config_string[index].val = deadbeef->conf_get_str_fast (config_name, spectrum_config_string[index].val_def);
+    // The string returned by conf_get_str_fast is only valid while the config is locked
+    g_free (c->strings[index]);
+    c->strings[index] = g_strdup (config_load_str (instance, spectrum_config_string[index].name, spectrum_config_string[index].val_def));
 }
 
-void
-load_config (void)
+static void
+config_gradient_colors_free (struct spectrum_config_t *c)
+{
+    g_list_foreach (c->gradient_colors, (GFunc) g_free, NULL);
+    g_list_free (c->gradient_colors);
+    c->gradient_colors = NULL;
+}
+
+// Fills the typed values from the raw ones
+static void
+config_finalize (struct spectrum_config_t *c)
+{
+    const int *v = c->ints;
+    c->fft_size = CLAMP (v[ID_FFT_SIZE], 512, MAX_FFT_SIZE);
+    c->window = v[ID_WINDOW];
+    c->channels = v[ID_CHANNEL];
+    c->amp_min = v[ID_AMPLITUDE_MIN];
+    c->amp_max = v[ID_AMPLITUDE_MAX];
+    c->db_range = v[ID_AMPLITUDE_MAX] - v[ID_AMPLITUDE_MIN];
+    c->note_min = v[ID_NOTE_MIN];
+    c->note_max = v[ID_NOTE_MAX];
+    c->num_notes = v[ID_NOTE_MAX] - v[ID_NOTE_MIN] + 1;
+    c->pitch = v[ID_PITCH];
+    c->transpose = v[ID_TRANSPOSE];
+    c->draw_style = v[ID_DRAW_STYLE];
+    c->interpolate = v[ID_INTERPOLATE] ? 1 : 0;
+    c->peaks = v[ID_ENABLE_PEAKS] && v[ID_PEAK_FALLOFF] >= 0;
+    c->peaks_color = v[ID_ENABLE_PEAKS_COLOR] ? 1 : 0;
+    c->bar_gravity = v[ID_ENABLE_AMPLITUDES] && v[ID_BAR_FALLOFF] >= 0;
+    c->bar_mode = v[ID_ENABLE_BAR_MODE] ? 1 : 0;
+    c->gaps = v[ID_GAPS] ? 1 : 0;
+    c->spacing = v[ID_SPACING] ? 1 : 0;
+    c->fill = v[ID_FILL_SPECTRUM] ? 1 : 0;
+}
+
+static void
+config_load (struct spectrum_config_t *c, int instance)
 {
     deadbeef->conf_lock ();
     for (int i = 0; i < NUM_ID_INT; i++) {
-        config_load_int (i);
+        config_load_int (c, instance, i);
     }
     for (int i = 0; i < NUM_ID_STRING; i++) {
-        config_load_string (i);
+        config_load_string (c, instance, i);
     }
     for (int i = 0; i < NUM_ID_COLOR; i++) {
-        config_load_color (i);
+        config_load_color (c, instance, i);
     }
 
     const size_t num_default_colors = 6;
@@ -216,62 +346,342 @@ load_config (void)
     };
 
     const char *color = NULL;
-    char conf_str[100] = {};
+    char name[100] = {};
 
-    g_list_foreach (CONFIG_GRADIENT_COLORS, (GFunc) g_free, NULL);
-    g_list_free (CONFIG_GRADIENT_COLORS);
-    CONFIG_GRADIENT_COLORS = NULL;
-    for (int i = 0; i < spectrum_config_int[ID_NUM_COLORS].val; i++) {
-        snprintf (conf_str, sizeof (conf_str), "%s%02d", CONFIG_PREFIX ".color.gradient_", i);
+    config_gradient_colors_free (c);
+    for (int i = 0; i < c->ints[ID_NUM_COLORS]; i++) {
+        snprintf (name, sizeof (name), "color.gradient_%02d", i);
         if (i < num_default_colors) {
-            color = deadbeef->conf_get_str_fast (conf_str, default_colors[i]);
+            color = config_load_str (instance, name, default_colors[i]);
         }
         else {
-            color = deadbeef->conf_get_str_fast (conf_str, "0 0 0");
+            color = config_load_str (instance, name, "0 0 0");
         }
         GdkColor *clr = g_new0 (GdkColor, 1);
         sscanf (color, CONFIG_COLOR_FORMAT_SHORT, &clr->red, &clr->green, &clr->blue);
-        CONFIG_GRADIENT_COLORS = g_list_append (CONFIG_GRADIENT_COLORS, clr);
+        c->gradient_colors = g_list_append (c->gradient_colors, clr);
     }
 
     deadbeef->conf_unlock ();
+    config_finalize (c);
+}
+
+static void
+config_save (struct spectrum_config_t *c, int instance)
+{
+    for (int i = 0; i < NUM_ID_INT; i++) {
+        config_save_int (c, instance, i);
+    }
+    for (int i = 0; i < NUM_ID_STRING; i++) {
+        config_save_string (c, instance, i);
+    }
+    for (int i = 0; i < NUM_ID_COLOR; i++) {
+        config_save_color (c, instance, i);
+    }
+
+    // Gradient colors
+    char color[100] = {};
+    char name[100] = {};
+    char conf_str[200] = {};
+    GList *l = c->gradient_colors;
+    for (int i = 0; l != NULL; l = l->next, i++) {
+        GdkColor *clr = l->data;
+        snprintf (color, sizeof (color), CONFIG_COLOR_FORMAT, clr->red, clr->green, clr->blue);
+        snprintf (name, sizeof (name), "color.gradient_%02d", i);
+        config_key (conf_str, sizeof (conf_str), instance, name);
+        deadbeef->conf_set_str (conf_str, color);
+    }
+}
+
+static struct spectrum_config_t *
+config_snapshot_new (void)
+{
+    struct spectrum_config_t *c = calloc (1, sizeof (struct spectrum_config_t));
+    c->refcount = 1;
+    return c;
+}
+
+static struct spectrum_config_t *
+config_snapshot_copy (const struct spectrum_config_t *src)
+{
+    struct spectrum_config_t *c = config_snapshot_new ();
+    memcpy (c->ints, src->ints, sizeof (c->ints));
+    memcpy (c->colors, src->colors, sizeof (c->colors));
+    for (int i = 0; i < NUM_ID_STRING; i++) {
+        c->strings[i] = g_strdup (src->strings[i]);
+    }
+    for (GList *l = src->gradient_colors; l != NULL; l = l->next) {
+        c->gradient_colors = g_list_append (c->gradient_colors, g_memdup (l->data, sizeof (GdkColor)));
+    }
+    config_finalize (c);
+    return c;
+}
+
+static void
+config_snapshot_unref (struct spectrum_config_t *c)
+{
+    if (!c || c == &config_fallback) {
+        return;
+    }
+    if (__atomic_sub_fetch (&c->refcount, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+    for (int i = 0; i < NUM_ID_STRING; i++) {
+        g_free (c->strings[i]);
+        c->strings[i] = NULL;
+    }
+    config_gradient_colors_free (c);
+    free (c);
+    c = NULL;
+}
+
+// Replaces the current snapshot of the store, takes over the reference of c
+static void
+config_store_publish (struct spectrum_config_store_t *store, struct spectrum_config_t *c)
+{
+    deadbeef->mutex_lock (store->mutex);
+    struct spectrum_config_t *prev = store->current;
+    c->generation = __atomic_add_fetch (&config_generation, 1, __ATOMIC_RELAXED);
+    store->current = c;
+    __atomic_store_n (&store->generation, c->generation, __ATOMIC_RELEASE);
+    deadbeef->mutex_unlock (store->mutex);
+    // Threads which still use it hold their own reference
+    config_snapshot_unref (prev);
+}
+
+unsigned int
+config_diff (const struct spectrum_config_t *a, const struct spectrum_config_t *b)
+{
+    if (!a || !b) {
+        return CONFIG_CHANGED_ALL;
+    }
+    if (a == b) {
+        return 0;
+    }
+    unsigned int changes = 0;
+    for (int i = 0; i < NUM_ID_INT; i++) {
+        if (a->ints[i] != b->ints[i]) {
+            changes |= config_int_changes[i];
+        }
+    }
+    for (int i = 0; i < NUM_ID_COLOR; i++) {
+        if (!gdk_color_equal (&a->colors[i], &b->colors[i])) {
+            changes |= config_color_changes[i];
+        }
+    }
+    for (int i = 0; i < NUM_ID_STRING; i++) {
+        if (g_strcmp0 (a->strings[i], b->strings[i]) != 0) {
+            changes |= config_string_changes[i];
+        }
+    }
+    GList *la = a->gradient_colors;
+    GList *lb = b->gradient_colors;
+    for (; la != NULL && lb != NULL; la = la->next, lb = lb->next) {
+        if (!gdk_color_equal (la->data, lb->data)) {
+            break;
+        }
+    }
+    if (la != NULL || lb != NULL) {
+        changes |= CONFIG_CHANGED_COLORS;
+    }
+    return changes;
+}
+
+static struct spectrum_config_t *
+config_store_pin (struct spectrum_config_store_t *store)
+{
+    deadbeef->mutex_lock (store->mutex);
+    struct spectrum_config_t *c = store->current;
+    __atomic_add_fetch (&c->refcount, 1, __ATOMIC_ACQ_REL);
+    deadbeef->mutex_unlock (store->mutex);
+    return c;
+}
+
+void
+load_config (void)
+{
+    struct spectrum_config_store_t *store = config_store_current;
+    if (!store) {
+        return;
+    }
+    struct spectrum_config_t *c = config_snapshot_new ();
+    config_load (c, store->instance);
+    // Most config changes are done by other plugins, keep the current
+    // snapshot then so nobody has to pin it again
+    if (!config_diff (store->current, c)) {
+        config_snapshot_unref (c);
+        return;
+    }
+    config_store_publish (store, c);
+    config_use (store);
+}
+
+void
+save_config (void)
+{
+    struct spectrum_config_store_t *store = config_store_current;
+    if (!store) {
+        return;
+    }
+    if (!store->draft) {
+        config_save (config_current, store->instance);
+        return;
+    }
+    struct spectrum_config_t *draft = store->draft;
+    store->draft = NULL;
+    config_finalize (draft);
+    config_save (draft, store->instance);
+    config_store_publish (store, draft);
+    config_use (store);
+}
+
+void
+config_init (void)
+{
+    config_load (&config_fallback, 0);
+}
+
+struct spectrum_config_store_t *
+config_store_new (int instance)
+{
+    struct spectrum_config_store_t *store = calloc (1, sizeof (struct spectrum_config_store_t));
+    store->instance = instance;
+    store->mutex = deadbeef->mutex_create ();
+    struct spectrum_config_t *c = config_snapshot_new ();
+    config_load (c, instance);
+    config_store_publish (store, c);
+    return store;
+}
+
+void
+config_store_free (struct spectrum_config_store_t *store)
+{
+    if (!store) {
+        return;
+    }
+    if (config_store_current == store) {
+        config_use (NULL);
+    }
+    config_snapshot_unref (store->draft);
+    store->draft = NULL;
+    config_snapshot_unref (store->applied);
+    store->applied = NULL;
+    config_snapshot_unref (store->current);
+    store->current = NULL;
+    if (store->mutex) {
+        deadbeef->mutex_free (store->mutex);
+        store->mutex = 0;
+    }
+    free (store);
+    store = NULL;
+}
+
+void
+config_use (struct spectrum_config_store_t *store)
+{
+    if (!store) {
+        config_snapshot_unref (config_current);
+        config_current = &config_fallback;
+        config_store_current = NULL;
+        return;
+    }
+    // Fast path, the thread already uses the latest snapshot
+    if (store == config_store_current
+        && config_current->generation == __atomic_load_n (&store->generation, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    struct spectrum_config_t *c = config_store_pin (store);
+    config_snapshot_unref (config_current);
+    config_current = c;
+    config_store_current = store;
+}
+
+const struct spectrum_config_t *
+config_get (void)
+{
+    return config_current;
+}
+
+unsigned int
+config_apply (void)
+{
+    struct spectrum_config_store_t *store = config_store_current;
+    if (!store || store->applied == config_current) {
+        return 0;
+    }
+    const unsigned int changes = config_diff (store->applied, config_current);
+    __atomic_add_fetch (&config_current->refcount, 1, __ATOMIC_ACQ_REL);
+    config_snapshot_unref (store->applied);
+    store->applied = config_current;
+    return changes;
+}
+
+// Snapshot the config_set_* functions write to
+static struct spectrum_config_t *
+config_draft_get (void)
+{
+    struct spectrum_config_store_t *store = config_store_current;
+    if (!store) {
+        return &config_fallback;
+    }
+    if (!store->draft) {
+        store->draft = config_snapshot_copy (config_current);
+    }
+    return store->draft;
+}
+
+GList *
+config_get_gradient_colors (void)
+{
+    return config_current->gradient_colors;
+}
+
+void
+config_set_gradient_colors (GList *colors)
+{
+    struct spectrum_config_t *c = config_draft_get ();
+    config_gradient_colors_free (c);
+    c->gradient_colors = colors;
 }
 
 void
 config_set_int (const int val, const int index)
 {
-    spectrum_config_int[index].val = val;
+    config_draft_get ()->ints[index] = val;
 }
 
 void
 config_set_string (const char *val, const int index)
 {
-    spectrum_config_string[index].val = val;
+    struct spectrum_config_t *c = config_draft_get ();
+    char *prev = c->strings[index];
+    c->strings[index] = g_strdup (val);
+    g_free (prev);
 }
 
 void
 config_set_color (const GdkColor *color, const int index)
 {
-    spectrum_config_color[index].val.red = color->red;
-    spectrum_config_color[index].val.green = color->green;
-    spectrum_config_color[index].val.blue = color->blue;
+    struct spectrum_config_t *c = config_draft_get ();
+    c->colors[index].red = color->red;
+    c->colors[index].green = color->green;
+    c->colors[index].blue = color->blue;
 }
 
 int
 config_get_int (const int index)
 {
-    return spectrum_config_int[index].val;
+    return config_current->ints[index];
 }
 
 const char *
 config_get_string (const int index)
 {
-    return spectrum_config_string[index].val;
+    return config_current->strings[index];
 }
 
 GdkColor *
 config_get_color (const int index)
 {
-    return &spectrum_config_color[index].val;
+    return &config_current->colors[index];
 }
-
@@ -27,6 +27,10 @@ enum spectrum_window {
     BLACKMAN_HARRIS_WINDOW,
     HANNING_WINDOW,
     NO_WINDOW,
+    NUTTALL_WINDOW,
+    FLAT_TOP_WINDOW,
+    KAISER_WINDOW,
+    GAUSSIAN_WINDOW,
     NUM_WINDOW
 };
 
@@ -40,6 +44,7 @@ enum spectrum_alignment {
 enum spectrum_style {
     MUSICAL_STYLE,
     SOLID_STYLE,
+    SPECTROGRAM_STYLE,
     NUM_STYLE
 };
 
@@ -88,12 +93,18 @@ enum spectrum_config_int_index {
     ID_SPACING,
     ID_DRAW_STYLE,
     ID_FILL_SPECTRUM,
+    ID_FRAME_DIVISOR,
+    ID_ADAPTIVE_REFRESH,
+    ID_REFRESH_INTERVAL_MAX,
+    ID_CPU_BUDGET,
+    ID_SPECTROGRAM_HISTORY,
+    ID_SHARED_MEMORY,
+    ID_SOCKET_STREAM,
     NUM_ID_INT
 };
 
 struct spectrum_config_int_t {
     const char *name;
-    int val;
     const int val_def;
 };
 
@@ -114,7 +125,6 @@ enum spectrum_config_color_index {
 
 struct spectrum_config_color_t {
     const char *name;
-    GdkColor val;
     const GdkColor val_def;
 };
 
@@ -124,18 +134,126 @@ extern struct spectrum_config_color_t spectrum_config_color[NUM_ID_COLOR];
 enum spectrum_config_string_index {
     ID_STRING_FONT,
     ID_STRING_FONT_TOOLTIP,
+    ID_STRING_RECORD_FILE,
+    ID_STRING_REPLAY_FILE,
     NUM_ID_STRING
 };
 
 struct spectrum_config_string_t {
     const char *name;
-    const char* val;
     const char *val_def;
 };
 
 extern struct spectrum_config_string_t spectrum_config_string[NUM_ID_STRING];
 
-extern GList *CONFIG_GRADIENT_COLORS;
+// Immutable snapshot of the settings of one widget instance. Every load builds
+// a new one which replaces the previous one as a whole, so readers never see
+// a partially loaded config.
+struct spectrum_config_t {
+    // raw values, indexed by the ID_* enums
+    int ints[NUM_ID_INT];
+    GdkColor colors[NUM_ID_COLOR];
+    char *strings[NUM_ID_STRING];
+    GList *gradient_colors;
+
+    // typed values for the hot paths
+    int fft_size;
+    int window;
+    uint32_t channels;
+    int amp_min;
+    int amp_max;
+    int db_range;
+    int note_min;
+    int note_max;
+    int num_notes;
+    int pitch;
+    int transpose;
+    int draw_style;
+    unsigned int interpolate : 1;
+    // peaks are shown and fall down
+    unsigned int peaks : 1;
+    unsigned int peaks_color : 1;
+    // bars fall down instead of following the amplitude
+    unsigned int bar_gravity : 1;
+    unsigned int bar_mode : 1;
+    unsigned int gaps : 1;
+    unsigned int spacing : 1;
+    unsigned int fill : 1;
+
+    // generation it got published with
+    uint64_t generation;
+    int refcount;
+};
+
+// Settings of one widget instance, holds the latest published snapshot
+struct spectrum_config_store_t {
+    // instance 0 uses the keys of the single instance versions,
+    // the others have their id added to the key
+    int instance;
+    // protects the fields below while snapshots get pinned or published
+    intptr_t mutex;
+    struct spectrum_config_t *current;
+    // changed together with current, read without the lock to find out
+    // whether a thread still uses the latest snapshot
+    uint64_t generation;
+    // snapshot modified by the config_set_* functions, published by save_config
+    struct spectrum_config_t *draft;
+    // snapshot the widget was last updated to, see config_apply
+    struct spectrum_config_t *applied;
+};
+
+// Parts of the widget which depend on the settings
+enum spectrum_config_change {
+    // analysis engine: fft size, window and channels
+    CONFIG_CHANGED_ANALYSIS = 1 << 0,
+    // number of bands and their frequencies
+    CONFIG_CHANGED_BANDS = 1 << 1,
+    // gradient and spectrogram palette
+    CONFIG_CHANGED_COLORS = 1 << 2,
+    // background, grid and labels
+    CONFIG_CHANGED_STATIC = 1 << 3,
+    // refresh interval and physics
+    CONFIG_CHANGED_TIMING = 1 << 4,
+    // settings which are read while drawing, nothing to rebuild
+    CONFIG_CHANGED_OTHER = 1 << 5,
+    CONFIG_CHANGED_ALL = (1 << 6) - 1
+};
+
+#define CONFIG_GRADIENT_COLORS (config_get_gradient_colors ())
+
+// The config_* accessors, load_config and save_config work on the store
+// which was last selected with config_use by the calling thread. Selecting
+// a store pins its latest snapshot until the thread selects again, so a
+// frame or callback sees the same values from start to end.
+void
+config_init (void);
+
+struct spectrum_config_store_t *
+config_store_new (int instance);
+
+void
+config_store_free (struct spectrum_config_store_t *store);
+
+void
+config_use (struct spectrum_config_store_t *store);
+
+// Snapshot pinned by the calling thread
+const struct spectrum_config_t *
+config_get (void);
+
+// Parts which differ between two snapshots, everything if one of them is NULL
+unsigned int
+config_diff (const struct spectrum_config_t *a, const struct spectrum_config_t *b);
+
+// Parts which changed since the last call for the selected store
+unsigned int
+config_apply (void);
+
+GList *
+config_get_gradient_colors (void);
+
+void
+config_set_gradient_colors (GList *colors);
 
 void
 load_config (void);
@@ -160,4 +278,3 @@ config_set_string (const char *val, const int index);
 
 void
 config_set_color (const GdkColor *color, const int index);
-
@@ -33,15 +33,16 @@
 #include "draw_utils.h"
 #include "utils.h"
 #include "spectrum.h"
+#include "worker.h"
 #include "interface.h"
 #include "callbacks.h"
 
 #define ARRAY_LEN(x)  (sizeof(x) / sizeof((x)[0]))
 
-static const char *window_functions[NUM_WINDOW] = {"Blackmann-Harris", "Hanning", "None"};
+static const char *window_functions[NUM_WINDOW] = {"Blackmann-Harris", "Hanning", "None", "Nuttall", "Flat top", "Kaiser", "Gaussian"};
 static const char *alignment_title[NUM_ALIGNMENT] = {"Left", "Right", "Center"};
 static const char *grad_orientation[NUM_ORIENTATION] = {"Vertical", "Horizontal"};
-static const char *visual_mode[NUM_STYLE] = {"Musical", "Solid"};
+static const char *visual_mode[NUM_STYLE] = {"Musical", "Solid", "Spectrogram"};
 
 static GtkWidget *channel_button = NULL;
 
@@ -246,7 +247,9 @@ static void
 get_color_button (GtkWidget *w, const char *w_name, const int index)
 {
     GtkColorButton *button = GTK_COLOR_BUTTON (lookup_widget (w, w_name));
-    gtk_color_button_get_color (button, &spectrum_config_color[index].val);
+    GdkColor color = {};
+    gtk_color_button_get_color (button, &color);
+    config_set_color (&color, index);
 }
 
 static void
@@ -273,20 +276,18 @@ set_font_button (GtkWidget *w, const char *w_name, const char *font)
 static void
 get_gradient_colors (GtkWidget *w)
 {
-    g_list_foreach (CONFIG_GRADIENT_COLORS, (GFunc) g_free, NULL);
-    g_list_free (CONFIG_GRADIENT_COLORS);
-    CONFIG_GRADIENT_COLORS = NULL;
-
     GtkContainer *color_box = GTK_CONTAINER (lookup_widget (w, "color_box"));
     GList *children = gtk_container_get_children (color_box);
+    GList *colors = NULL;
 
     int i = 0;
     for (GList *c = children; c != NULL; c = c->next, i++) {
         GtkColorButton *button = GTK_COLOR_BUTTON (c->data);
         GdkColor *clr = g_new0 (GdkColor, 1);
         gtk_color_button_get_color (button, clr);
-        CONFIG_GRADIENT_COLORS = g_list_append (CONFIG_GRADIENT_COLORS, clr);
+        colors = g_list_append (colors, clr);
     }
+    config_set_gradient_colors (colors);
     config_set_int (i, ID_NUM_COLORS);
     g_list_free (children);
 }
@@ -430,7 +431,7 @@ set_config_values (GtkWidget *w)
         struct config_dialog_entry_t entry = color_button_entries[i];
         set_color_button (w, entry.name, config_get_color (entry.id));
     }
-    const int fft_index = log2 (spectrum_config_int[ID_FFT_SIZE].val) - 9;
+    const int fft_index = log2 (config_get_int (ID_FFT_SIZE)) - 9;
     set_spin_button (w, "fft_spin", fft_index);
 
     for (int i = 0; i < ARRAY_LEN (combo_button_entries); i++) {
@@ -545,6 +546,8 @@ set_callbacks (GtkWidget *w, GtkWidget *popup)
 void
 on_button_config (GtkMenuItem *menuitem, gpointer user_data)
 {
+    w_spectrum_t *w = user_data;
+    config_use (w->config);
     GtkWidget *dialog = create_config_dialog ();
     GtkWidget *popup = create_channel_menu ();
 
@@ -554,9 +557,14 @@ on_button_config (GtkMenuItem *menuitem, gpointer user_data)
 
     while (TRUE) {
         int response = gtk_dialog_run (GTK_DIALOG (dialog));
+        // Other instances might have been active while the dialog was running
+        config_use (w->config);
         if (response == GTK_RESPONSE_OK || response == GTK_RESPONSE_APPLY) {
+            // The render worker must not see the config while it's being replaced
+            spectrum_worker_lock (w->worker);
             get_config_values (dialog);
             get_channel_config_values (popup);
+            spectrum_worker_unlock (w->worker);
             save_config ();
             deadbeef->sendmessage (DB_EV_CONFIGCHANGED, 0, 0, 0);
         }
@@ -0,0 +1,97 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Prints a recording of the plugin as CSV, one line per frame with the time
+// in seconds and the level of every band. Start recording with
+//   musical_spectrum.record_file /path/to/file
+// in the DeaDBeeF config (musical_spectrum.<instance>.record_file for further
+// instances), then run
+//   record_dump file [-p]
+// -p prints the peaks instead of the levels.
+//
+// Build: cc -O2 -o record_dump record_dump.c
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../spectrum_record.h"
+
+int
+main (int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf (stderr, "usage: %s file [-p]\n", argv[0]);
+        return 1;
+    }
+    const int peaks = argc > 2 && strcmp (argv[2], "-p") == 0;
+
+    const int fd = open (argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat (fd, &st) != 0) {
+        perror (argv[1]);
+        return 1;
+    }
+    if ((size_t)st.st_size < sizeof (struct spectrum_record_header_t)) {
+        fprintf (stderr, "%s: not a recording\n", argv[1]);
+        return 1;
+    }
+    const struct spectrum_record_header_t *h = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (h == MAP_FAILED) {
+        perror ("mmap");
+        return 1;
+    }
+    const uint64_t size = st.st_size;
+    if (h->magic != SPECTRUM_RECORD_MAGIC || h->version != SPECTRUM_RECORD_VERSION
+        || h->data_offset < sizeof (struct spectrum_record_header_t) + h->num_bands * sizeof (float)
+        || h->record_size < sizeof (struct spectrum_record_t) + 2 * h->num_bands * sizeof (float)
+        || h->data_offset > size
+        || h->num_records > (size - h->data_offset) / h->record_size) {
+        fprintf (stderr, "%s: unknown or truncated recording\n", argv[1]);
+        return 1;
+    }
+
+    fprintf (stderr, "%llu frames, %u bands, %u Hz, FFT size %u, hop %.1f ms, %.0f to %.0f dB\n",
+             (unsigned long long)h->num_records, h->num_bands, h->samplerate, h->fft_size,
+             h->hop / 1000.0, h->amp_min, h->amp_max);
+
+    const float *frequency = spectrum_record_frequency (h);
+    printf ("time");
+    for (uint32_t i = 0; i < h->num_bands; i++) {
+        printf (",%.2f", frequency[i]);
+    }
+    printf ("\n");
+    for (uint64_t n = 0; n < h->num_records; n++) {
+        const struct spectrum_record_t *r = spectrum_record_get (h, n);
+        const float *values = r->values + (peaks ? h->num_bands : 0);
+        printf ("%.6f", r->time / 1e6);
+        for (uint32_t i = 0; i < h->num_bands; i++) {
+            // silent bands are -FLT_MAX, below anything displayed
+            printf (",%.2f", values[i] < h->amp_min ? h->amp_min : values[i]);
+        }
+        printf ("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Reads the bands the plugin publishes to shared memory and prints the
+// loudest band of every new frame. Enable publishing with
+//   musical_spectrum.shared_memory 1
+// in the DeaDBeeF config (musical_spectrum.<instance>.shared_memory for
+// further instances), then run
+//   shm_reader [instance]
+//
+// Build: cc -O2 -o shm_reader shm_reader.c (add -lrt for glibc older than 2.34)
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "../spectrum_shm.h"
+
+static const struct spectrum_shm_t *
+shm_map (int instance)
+{
+    char name[64];
+    snprintf (name, sizeof (name), SPECTRUM_SHM_NAME, (unsigned int)getuid (), instance);
+    const int fd = shm_open (name, O_RDONLY, 0);
+    if (fd < 0) {
+        perror (name);
+        return NULL;
+    }
+    const struct spectrum_shm_t *shm = mmap (NULL, sizeof (struct spectrum_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (shm == MAP_FAILED) {
+        perror ("mmap");
+        return NULL;
+    }
+    if (__atomic_load_n (&shm->magic, __ATOMIC_ACQUIRE) != SPECTRUM_SHM_MAGIC
+        || shm->version != SPECTRUM_SHM_VERSION) {
+        fprintf (stderr, "%s: unknown layout\n", name);
+        munmap ((void *)shm, sizeof (struct spectrum_shm_t));
+        return NULL;
+    }
+    return shm;
+}
+
+int
+main (int argc, char **argv)
+{
+    const int instance = argc > 1 ? atoi (argv[1]) : 0;
+    const struct spectrum_shm_t *shm = shm_map (instance);
+    if (!shm) {
+        return 1;
+    }
+
+    static float bands[SPECTRUM_SHM_CAPACITY];
+    static float frequency[SPECTRUM_SHM_CAPACITY];
+    uint64_t last_frame = 0;
+    while (1) {
+        struct spectrum_shm_frame_t info;
+        if (spectrum_shm_read (shm, &info, bands, NULL, frequency, SPECTRUM_SHM_CAPACITY) == 0
+            && info.frame != last_frame) {
+            last_frame = info.frame;
+            uint32_t loudest = 0;
+            for (uint32_t i = 1; i < info.num_bands; i++) {
+                if (bands[i] > bands[loudest]) {
+                    loudest = i;
+                }
+            }
+            if (info.num_bands > 0) {
+                printf ("frame %llu: %u bands, loudest %.1f Hz at %.1f dB\n", (unsigned long long)info.frame,
+                        info.num_bands, frequency[loudest], bands[loudest]);
+                fflush (stdout);
+            }
+        }
+        // a bit faster than the fastest refresh rate of the widget
+        const struct timespec interval = {0, 4 * 1000 * 1000};
+        nanosleep (&interval, NULL);
+    }
+    return 0;
+}
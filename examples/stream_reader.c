@@ -0,0 +1,125 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Connects to the socket the plugin streams the bands to and prints the
+// loudest band of every frame. Enable streaming with
+//   musical_spectrum.socket_stream 8
+// (or 16) in the DeaDBeeF config (musical_spectrum.<instance>.socket_stream
+// for further instances), then run
+//   stream_reader [instance]
+//
+// Build: cc -O2 -o stream_reader stream_reader.c
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../spectrum_stream.h"
+
+static int
+stream_connect (int instance)
+{
+    struct sockaddr_un addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    const int len = spectrum_stream_path (addr.sun_path, sizeof (addr.sun_path), instance);
+    if (len < 0 || (size_t)len >= sizeof (addr.sun_path)) {
+        fprintf (stderr, "socket path too long\n");
+        return -1;
+    }
+    const int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror ("socket");
+        return -1;
+    }
+    if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+        perror (addr.sun_path);
+        close (fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Reads exactly size bytes, returns 0 on success and -1 on error or EOF
+static int
+read_exactly (int fd, void *dest, size_t size)
+{
+    char *p = dest;
+    while (size > 0) {
+        const ssize_t n = read (fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    const int instance = argc > 1 ? atoi (argv[1]) : 0;
+    const int fd = stream_connect (instance);
+    if (fd < 0) {
+        return 1;
+    }
+
+    static uint16_t values[65536];
+    struct spectrum_stream_header_t header;
+    while (read_exactly (fd, &header, sizeof (header)) == 0) {
+        if (header.magic != SPECTRUM_STREAM_MAGIC || header.version != SPECTRUM_STREAM_VERSION
+            || (header.bits != 8 && header.bits != 16)) {
+            fprintf (stderr, "unknown protocol\n");
+            break;
+        }
+        const size_t payload = header.size - sizeof (header);
+        if (header.size < sizeof (header) || payload > sizeof (values)
+            || payload != (size_t)header.num_bands * (header.bits / 8)) {
+            fprintf (stderr, "invalid frame size %u\n", header.size);
+            break;
+        }
+        if (read_exactly (fd, values, payload) != 0) {
+            break;
+        }
+        uint32_t loudest = 0;
+        uint32_t loudest_value = 0;
+        for (uint32_t i = 0; i < header.num_bands; i++) {
+            const uint32_t v = header.bits == 8 ? ((uint8_t *)values)[i] : values[i];
+            if (v > loudest_value) {
+                loudest = i;
+                loudest_value = v;
+            }
+        }
+        printf ("frame %llu: %u bands, %u dropped, loudest band %u at %.1f dB\n",
+                (unsigned long long)header.frame, header.num_bands, header.dropped, loudest,
+                spectrum_stream_db (&header, loudest_value));
+        fflush (stdout);
+    }
+    close (fd);
+    return 0;
+}
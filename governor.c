@@ -0,0 +1,78 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <math.h>
+#include <glib.h>
+
+#include "config.h"
+#include "governor.h"
+
+// Mean change of the displayed amplitudes (dB per band and frame) at which
+// we run at the slowest/fastest refresh rate
+#define ACTIVITY_LOW 0.2
+#define ACTIVITY_HIGH 3.0
+// How fast the activity estimate decays after a transient
+#define ACTIVITY_DECAY 0.9
+#define COST_SMOOTHING 0.9
+// Upper bound for the interval, even if the CPU budget asks for more
+#define INTERVAL_LIMIT 1000.0
+
+void
+governor_reset (struct spectrum_governor_t *gov, double interval)
+{
+    gov->interval = interval;
+    gov->activity = ACTIVITY_HIGH;
+    gov->cost = 0;
+}
+
+double
+governor_update (struct spectrum_governor_t *gov, double change, double cost)
+{
+    const double interval_min = config_get_int (ID_REFRESH_INTERVAL);
+    const double interval_max = MAX (interval_min, config_get_int (ID_REFRESH_INTERVAL_MAX));
+
+    // React to transients immediately, but calm down slowly
+    if (change > gov->activity) {
+        gov->activity = change;
+    }
+    else {
+        gov->activity = ACTIVITY_DECAY * gov->activity + (1 - ACTIVITY_DECAY) * change;
+    }
+    gov->cost = COST_SMOOTHING * gov->cost + (1 - COST_SMOOTHING) * cost;
+
+    // Interpolate between the slowest and fastest rate on a log scale of the activity
+    double t = 0;
+    if (gov->activity >= ACTIVITY_HIGH) {
+        t = 1;
+    }
+    else if (gov->activity > ACTIVITY_LOW) {
+        t = log (gov->activity / ACTIVITY_LOW) / log (ACTIVITY_HIGH / ACTIVITY_LOW);
+    }
+    double interval = interval_max - t * (interval_max - interval_min);
+
+    // Never spend more than the configured share of CPU time on drawing
+    const int budget = config_get_int (ID_CPU_BUDGET);
+    if (budget > 0) {
+        interval = MAX (interval, gov->cost * 100.0 / budget);
+    }
+
+    gov->interval = CLAMP (interval, interval_min, MAX (interval_max, INTERVAL_LIMIT));
+    return gov->interval;
+}
@@ -0,0 +1,36 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+struct spectrum_governor_t {
+    // current refresh interval in ms
+    double interval;
+    // smoothed spectral change per frame in dB
+    double activity;
+    // smoothed cost of a frame in ms
+    double cost;
+};
+
+void
+governor_reset (struct spectrum_governor_t *gov, double interval);
+
+double
+governor_update (struct spectrum_governor_t *gov, double change, double cost);
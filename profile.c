@@ -0,0 +1,161 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "spectrum.h"
+#include "profile.h"
+
+const char *spectrum_profile_stage_names[NUM_PROFILE_STAGE] = {
+    [PROFILE_INGEST] = "ingest",
+    [PROFILE_FFT] = "fft",
+    [PROFILE_BANDS] = "bands",
+    [PROFILE_PHYSICS] = "physics",
+    [PROFILE_STATIC] = "static",
+    [PROFILE_LABELS] = "labels",
+    [PROFILE_BARS] = "bars",
+    [PROFILE_FRAME] = "frame",
+    [PROFILE_TOOLTIP] = "tooltip",
+};
+
+int profile_users = 0;
+
+struct spectrum_profile_t *
+spectrum_profile_new (void)
+{
+    struct spectrum_profile_t *p = calloc (1, sizeof (struct spectrum_profile_t));
+    p->mutex = deadbeef->mutex_create ();
+    return p;
+}
+
+void
+spectrum_profile_free (struct spectrum_profile_t *p)
+{
+    if (!p) {
+        return;
+    }
+    if (p->mutex) {
+        deadbeef->mutex_free (p->mutex);
+        p->mutex = 0;
+    }
+    free (p);
+    p = NULL;
+}
+
+void
+spectrum_profile_reset (struct spectrum_profile_t *p)
+{
+    deadbeef->mutex_lock (p->mutex);
+    memset (p->stages, 0, sizeof (p->stages));
+    p->frames = 0;
+    p->late_frames = 0;
+    deadbeef->mutex_unlock (p->mutex);
+}
+
+void
+spectrum_profile_enable (int enable)
+{
+    __atomic_add_fetch (&profile_users, enable ? 1 : -1, __ATOMIC_RELAXED);
+}
+
+static void
+profile_sample_add (struct spectrum_profile_t *p, int stage, double duration)
+{
+    struct spectrum_profile_stage_t *s = &p->stages[stage];
+    s->samples[s->pos] = duration;
+    s->pos = (s->pos + 1) % PROFILE_SAMPLES;
+    s->num_samples = MIN (s->num_samples + 1, PROFILE_SAMPLES);
+}
+
+void
+spectrum_profile_end (struct spectrum_profile_t *p, int stage, gint64 start)
+{
+    if (!start) {
+        return;
+    }
+    const gint64 end = g_get_monotonic_time ();
+    spectrum_trace_event (spectrum_profile_stage_names[stage], start, end);
+    if (!p) {
+        return;
+    }
+    const double duration = end - start;
+    deadbeef->mutex_lock (p->mutex);
+    profile_sample_add (p, stage, duration);
+    deadbeef->mutex_unlock (p->mutex);
+}
+
+void
+spectrum_profile_frame_end (struct spectrum_profile_t *p, gint64 start, double interval)
+{
+    if (!start) {
+        return;
+    }
+    const gint64 end = g_get_monotonic_time ();
+    spectrum_trace_event (spectrum_profile_stage_names[PROFILE_FRAME], start, end);
+    if (!p) {
+        return;
+    }
+    const double duration = end - start;
+    deadbeef->mutex_lock (p->mutex);
+    profile_sample_add (p, PROFILE_FRAME, duration);
+    p->frames++;
+    if (duration > interval * 1000.0) {
+        p->late_frames++;
+    }
+    deadbeef->mutex_unlock (p->mutex);
+}
+
+static int
+compare_doubles (const void *a, const void *b)
+{
+    const double x = *(const double *)a;
+    const double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest rank percentile of sorted values
+static double
+percentile (const double *sorted, int n, double q)
+{
+    const int rank = (int)ceil (q * n);
+    return sorted[CLAMP (rank - 1, 0, n - 1)];
+}
+
+void
+spectrum_profile_stats_get (struct spectrum_profile_t *p, int stage, struct spectrum_profile_stats_t *stats)
+{
+    double sorted[PROFILE_SAMPLES];
+    deadbeef->mutex_lock (p->mutex);
+    const int n = p->stages[stage].num_samples;
+    memcpy (sorted, p->stages[stage].samples, n * sizeof (double));
+    deadbeef->mutex_unlock (p->mutex);
+
+    memset (stats, 0, sizeof (*stats));
+    stats->num_samples = n;
+    if (n == 0) {
+        return;
+    }
+    qsort (sorted, n, sizeof (double), compare_doubles);
+    stats->p50 = percentile (sorted, n, 0.5);
+    stats->p95 = percentile (sorted, n, 0.95);
+    stats->p99 = percentile (sorted, n, 0.99);
+    stats->max = sorted[n - 1];
+}
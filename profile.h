@@ -0,0 +1,106 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <glib.h>
+
+#include "trace.h"
+
+// Number of recent samples the statistics of a stage are computed from
+#define PROFILE_SAMPLES 256
+
+enum spectrum_profile_stage {
+    // audio thread: samples handed to the analysis engine
+    PROFILE_INGEST,
+    PROFILE_FFT,
+    // render worker
+    PROFILE_BANDS,
+    PROFILE_PHYSICS,
+    PROFILE_STATIC,
+    PROFILE_LABELS,
+    PROFILE_BARS,
+    PROFILE_FRAME,
+    // main thread: hover effects
+    PROFILE_TOOLTIP,
+    NUM_PROFILE_STAGE
+};
+
+struct spectrum_profile_stage_t {
+    // durations in µs, ring buffer
+    double samples[PROFILE_SAMPLES];
+    int num_samples;
+    int pos;
+};
+
+// Timings of one widget or analysis engine
+struct spectrum_profile_t {
+    // protects the fields below, stages are timed on different threads
+    intptr_t mutex;
+    struct spectrum_profile_stage_t stages[NUM_PROFILE_STAGE];
+    // frames which took longer than the refresh interval
+    uint64_t frames;
+    uint64_t late_frames;
+};
+
+struct spectrum_profile_stats_t {
+    int num_samples;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+};
+
+extern const char *spectrum_profile_stage_names[NUM_PROFILE_STAGE];
+
+// Number of shown performance overlays, nothing gets timed while it is zero
+// and tracing is off
+extern int profile_users;
+
+struct spectrum_profile_t *
+spectrum_profile_new (void);
+
+void
+spectrum_profile_free (struct spectrum_profile_t *p);
+
+void
+spectrum_profile_reset (struct spectrum_profile_t *p);
+
+void
+spectrum_profile_enable (int enable);
+
+// Start of a timed section, 0 if neither profiling nor tracing is on
+static inline gint64
+spectrum_profile_begin (void)
+{
+    return (__atomic_load_n (&profile_users, __ATOMIC_RELAXED) > 0 || trace_enabled) ? g_get_monotonic_time () : 0;
+}
+
+// Records the time since start and adds it to the trace, does nothing if start is 0
+void
+spectrum_profile_end (struct spectrum_profile_t *p, int stage, gint64 start);
+
+// Like spectrum_profile_end for the whole frame, counts it as late if it took
+// longer than interval (ms)
+void
+spectrum_profile_frame_end (struct spectrum_profile_t *p, gint64 start, double interval);
+
+void
+spectrum_profile_stats_get (struct spectrum_profile_t *p, int stage, struct spectrum_profile_stats_t *stats);
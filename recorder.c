@@ -0,0 +1,213 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <gtk/gtk.h>
+
+#include "recorder.h"
+
+#define RECORD_ALIGN(x, a) (((x) + (a) - 1) / (a) * (a))
+
+struct spectrum_recorder_t *
+spectrum_recorder_new (const char *path)
+{
+    struct spectrum_recorder_t *rec = calloc (1, sizeof (struct spectrum_recorder_t));
+    if (!rec) {
+        return NULL;
+    }
+    rec->path = g_strdup (path);
+    rec->fd = -1;
+    return rec;
+}
+
+// Makes the file size bytes large and maps all of it
+static int
+spectrum_recorder_grow (struct spectrum_recorder_t *rec, size_t size)
+{
+    // Allocates the blocks now rather than when the pages are first written
+    if (posix_fallocate (rec->fd, 0, size) != 0 && ftruncate (rec->fd, size) != 0) {
+        return -1;
+    }
+    void *map = rec->map ? mremap (rec->map, rec->map_size, size, MREMAP_MAYMOVE)
+                         : mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, rec->fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    rec->map = map;
+    rec->map_size = size;
+    rec->header = map;
+    return 0;
+}
+
+// Drops the preallocated space behind the last record
+static void
+spectrum_recorder_close (struct spectrum_recorder_t *rec)
+{
+    if (rec->map) {
+        const struct spectrum_record_header_t *h = rec->header;
+        const off_t size = h->data_offset + h->num_records * h->record_size;
+        munmap (rec->map, rec->map_size);
+        rec->map = NULL;
+        rec->map_size = 0;
+        rec->header = NULL;
+        if (ftruncate (rec->fd, size) != 0) {
+            fprintf (stderr, "musical spectrum: failed to truncate recording\n");
+        }
+    }
+    if (rec->fd >= 0) {
+        close (rec->fd);
+        rec->fd = -1;
+    }
+}
+
+void
+spectrum_recorder_free (struct spectrum_recorder_t *rec)
+{
+    if (!rec) {
+        return;
+    }
+    spectrum_recorder_close (rec);
+    g_free (rec->path);
+    rec->path = NULL;
+    free (rec);
+    rec = NULL;
+}
+
+static int
+spectrum_recorder_open (struct spectrum_recorder_t *rec, const double *frequency, int num_bands,
+                        int samplerate, int fft_size, double hop, int amp_min, int amp_max)
+{
+    char *name = rec->files ? g_strdup_printf ("%s.%d", rec->path, rec->files) : g_strdup (rec->path);
+    rec->files++;
+    rec->fd = open (name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    const size_t data_offset = RECORD_ALIGN (sizeof (struct spectrum_record_header_t) + num_bands * sizeof (float), 64);
+    if (rec->fd < 0 || spectrum_recorder_grow (rec, data_offset + RECORD_CHUNK) != 0) {
+        fprintf (stderr, "musical spectrum: failed to create recording %s\n", name);
+        spectrum_recorder_close (rec);
+        g_free (name);
+        return -1;
+    }
+    g_free (name);
+
+    struct spectrum_record_header_t *h = rec->header;
+    h->version = SPECTRUM_RECORD_VERSION;
+    h->data_offset = data_offset;
+    h->record_size = RECORD_ALIGN (sizeof (struct spectrum_record_t) + 2 * num_bands * sizeof (float), 8);
+    h->num_bands = num_bands;
+    h->samplerate = samplerate;
+    h->fft_size = fft_size;
+    h->hop = hop * 1000;
+    h->amp_min = amp_min;
+    h->amp_max = amp_max;
+    h->num_records = 0;
+    h->start_time = g_get_real_time ();
+    float *f = (float *)(h + 1);
+    for (int i = 0; i < num_bands; i++) {
+        f[i] = frequency[i];
+    }
+    __atomic_store_n (&h->magic, SPECTRUM_RECORD_MAGIC, __ATOMIC_RELEASE);
+    rec->synced = 0;
+    rec->start = -1;
+    return 0;
+}
+
+static int
+spectrum_recorder_matches (const struct spectrum_record_header_t *h, const double *frequency, int num_bands,
+                           int samplerate, int fft_size, double hop, int amp_min, int amp_max)
+{
+    // Replays step through the records by the hop of the header, a new frame
+    // rate needs a new file
+    if (h->num_bands != num_bands || h->samplerate != samplerate || h->fft_size != fft_size
+        || h->hop != (uint32_t)(hop * 1000) || h->amp_min != amp_min || h->amp_max != amp_max) {
+        return 0;
+    }
+    const float *f = spectrum_record_frequency (h);
+    for (int i = 0; i < num_bands; i++) {
+        if (f[i] != (float)frequency[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Starts writeback of the records since the last call without waiting for it
+static void
+spectrum_recorder_sync (struct spectrum_recorder_t *rec)
+{
+    const struct spectrum_record_header_t *h = rec->header;
+    const size_t page_size = sysconf (_SC_PAGESIZE);
+    const size_t start = (h->data_offset + rec->synced * h->record_size) / page_size * page_size;
+    const size_t end = h->data_offset + h->num_records * h->record_size;
+    msync (rec->map + start, end - start, MS_ASYNC);
+    rec->synced = h->num_records;
+}
+
+void
+spectrum_recorder_append (struct spectrum_recorder_t *rec, const double *levels, const double *peaks,
+                          const double *frequency, int num_bands, int samplerate, int fft_size,
+                          double hop, int amp_min, int amp_max)
+{
+    if (rec->failed) {
+        return;
+    }
+    if (rec->header && !spectrum_recorder_matches (rec->header, frequency, num_bands, samplerate, fft_size, hop, amp_min, amp_max)) {
+        spectrum_recorder_close (rec);
+    }
+    if (!rec->header
+        && spectrum_recorder_open (rec, frequency, num_bands, samplerate, fft_size, hop, amp_min, amp_max) != 0) {
+        rec->failed = 1;
+        return;
+    }
+
+    const uint64_t n = rec->header->num_records;
+    const size_t end = rec->header->data_offset + (n + 1) * rec->header->record_size;
+    if (end > rec->map_size && spectrum_recorder_grow (rec, rec->map_size + RECORD_CHUNK) != 0) {
+        fprintf (stderr, "musical spectrum: failed to grow recording %s\n", rec->path);
+        spectrum_recorder_close (rec);
+        rec->failed = 1;
+        return;
+    }
+
+    struct spectrum_record_header_t *h = rec->header;
+    const gint64 now = g_get_monotonic_time ();
+    if (rec->start < 0) {
+        rec->start = now;
+    }
+    struct spectrum_record_t *r = (struct spectrum_record_t *)(rec->map + h->data_offset + n * h->record_size);
+    r->time = now - rec->start;
+    float *l = r->values;
+    float *p = r->values + num_bands;
+    for (int i = 0; i < num_bands; i++) {
+        l[i] = MAX (levels[i], -FLT_MAX);
+        p[i] = MAX (peaks[i], 0) + amp_min;
+    }
+    // Readers of a file being written only look at complete records
+    __atomic_store_n (&h->num_records, n + 1, __ATOMIC_RELEASE);
+
+    if (n + 1 - rec->synced >= RECORD_SYNC) {
+        spectrum_recorder_sync (rec);
+    }
+}
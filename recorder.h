@@ -0,0 +1,64 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "spectrum_record.h"
+
+// The file grows by this much at a time, so appending a record mostly is a
+// memcpy into the mapping
+#define RECORD_CHUNK (16 << 20)
+// Records after which the written range is handed to the kernel for writeback
+#define RECORD_SYNC 64
+
+// Appends frames to a memory mapped file in the format of spectrum_record.h.
+// Only used by the render worker.
+struct spectrum_recorder_t {
+    char *path;
+    // files started so far, a change of the bands starts a new one
+    int files;
+    // set if the file couldn't be created, we don't retry for the same path
+    int failed;
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    struct spectrum_record_header_t *header;
+    // records already handed to the kernel for writeback
+    uint64_t synced;
+    int64_t start;
+};
+
+struct spectrum_recorder_t *
+spectrum_recorder_new (const char *path);
+
+// Truncates the file to the recorded frames and closes it
+void
+spectrum_recorder_free (struct spectrum_recorder_t *rec);
+
+// Appends a frame, levels are absolute, peaks relative to amp_min as the
+// render state keeps them. If the bands or the frame rate differ from the
+// ones of the file a new file is started, named path.1, path.2 and so on.
+void
+spectrum_recorder_append (struct spectrum_recorder_t *rec, const double *levels, const double *peaks,
+                          const double *frequency, int num_bands, int samplerate, int fft_size,
+                          double hop, int amp_min, int amp_max);
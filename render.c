@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <gdk/gdk.h>
 #include <stdint.h>
@@ -10,28 +11,24 @@
 #include "draw_utils.h"
 #include "spectrum.h"
 #include "support.h"
+#include "spectrogram.h"
+#include "worker.h"
+#include "analysis.h"
+#include "profile.h"
+#include "arena.h"
+#include "shm.h"
+#include "stream.h"
+#include "api.h"
+#include "recorder.h"
+#include "replay.h"
 
 #define TOP_EXTRA_SPACE 10
 #define DB_GRID_DISTANCE 10
 #define FONT_PADDING_HORIZONTAL 8
 #define FONT_PADDING_VERTICAL 0
 #define NUM_NOTES_FOR_OCTAVE 12
-
-struct spectrum_render_ctx_t {
-    int num_bands;
-    double band_width;
-    double note_width;
-    // Spectrum rectangle
-    cairo_rectangle_t center;
-    // Left labels rectangle
-    cairo_rectangle_t left;
-    // Right labels rectangle
-    cairo_rectangle_t right;
-    // Top labels rectangle
-    cairo_rectangle_t top;
-    // Bottom labels rectangle
-    cairo_rectangle_t bottom;
-};
+#define TOOLTIP_PADDING 5
+#define HUD_PADDING 4
 
 void
 spectrum_data_free (struct spectrum_data_t *data)
@@ -39,46 +36,6 @@ spectrum_data_free (struct spectrum_data_t *data)
     if (!data) {
         return;
     }
-    if (data->samples) {
-        free (data->samples);
-        data->samples = NULL;
-    }
-    if (data->spectrum) {
-        free (data->spectrum);
-        data->spectrum = NULL;
-    }
-    if (data->window) {
-        free (data->window);
-        data->window = NULL;
-    }
-    if (data->frequency) {
-        free (data->frequency);
-        data->frequency = NULL;
-    }
-    if (data->keys) {
-        free (data->keys);
-        data->keys = NULL;
-    }
-    if (data->low_res_indices) {
-        free (data->low_res_indices);
-        data->low_res_indices = NULL;
-    }
-    if (data->fft_in) {
-        fftw_free (data->fft_in);
-        data->fft_in = NULL;
-    }
-    if (data->fft_out) {
-        fftw_free (data->fft_out);
-        data->fft_out = NULL;
-    }
-    if (data->fft_plan) {
-        fftw_destroy_plan (data->fft_plan);
-        data->fft_plan = NULL;
-    }
-    if (data->mutex) {
-        deadbeef->mutex_free (data->mutex);
-        data->mutex = 0;
-    }
     free (data);
     data = NULL;
 }
@@ -89,38 +46,18 @@ spectrum_render_free (struct spectrum_render_t *render)
     if (!render) {
         return;
     }
-    if (render->bars) {
-        free (render->bars);
-        render->bars = NULL;
-    }
-    if (render->bars_peak) {
-        free (render->bars_peak);
-        render->bars_peak = NULL;
-    }
-    if (render->peaks) {
-        free (render->peaks);
-        render->peaks = NULL;
-    }
-    if (render->v_bars) {
-        free (render->v_bars);
-        render->v_bars = NULL;
-    }
-    if (render->v_peaks) {
-        free (render->v_peaks);
-        render->v_peaks = NULL;
-    }
-    if (render->delay_bars) {
-        free (render->delay_bars);
-        render->delay_bars = NULL;
-    }
-    if (render->delay_peaks) {
-        free (render->delay_peaks);
-        render->delay_peaks = NULL;
-    }
     if (render->pattern) {
         cairo_pattern_destroy (render->pattern);
         render->pattern = NULL;
     }
+    if (render->spectrogram) {
+        spectrogram_free (render->spectrogram);
+        render->spectrogram = NULL;
+    }
+    if (render->static_layer) {
+        cairo_surface_destroy (render->static_layer);
+        render->static_layer = NULL;
+    }
     free (render);
     render = NULL;
 }
@@ -128,39 +65,67 @@ spectrum_render_free (struct spectrum_render_t *render)
 struct spectrum_data_t *
 spectrum_data_new (void)
 {
-    struct spectrum_data_t *s_data = calloc (1, sizeof (struct spectrum_data_t));
-    s_data->samples = calloc (MAX_FFT_SIZE * DDB_FREQ_MAX_CHANNELS, sizeof (float));
-    s_data->spectrum = calloc (MAX_FFT_SIZE, sizeof (double));
-    s_data->window = calloc (MAX_FFT_SIZE, sizeof (double));
-    s_data->frequency = calloc (MAX_FFT_SIZE, sizeof (double));
-    s_data->keys = calloc (MAX_FFT_SIZE, sizeof (int));
-    s_data->low_res_indices = calloc (MAX_FFT_SIZE, sizeof (int));
-    s_data->fft_in = fftw_alloc_real (MAX_FFT_SIZE);
-    s_data->fft_out = fftw_alloc_complex (MAX_FFT_SIZE);
-    s_data->fft_plan = fftw_plan_dft_r2c_1d (CLAMP (config_get_int (ID_FFT_SIZE), 512, MAX_FFT_SIZE), s_data->fft_in, s_data->fft_out, FFTW_ESTIMATE);
-    s_data->mutex = deadbeef->mutex_create ();
-    return s_data;
+    return calloc (1, sizeof (struct spectrum_data_t));
 }
 
 struct spectrum_render_t *
 spectrum_render_new (void)
 {
     struct spectrum_render_t *render = calloc (1, sizeof (struct spectrum_render_t));
-    render->bars = calloc (MAX_FFT_SIZE, sizeof (double));
-    render->bars_peak = calloc (MAX_FFT_SIZE, sizeof (double));
-    render->peaks = calloc (MAX_FFT_SIZE, sizeof (double));
-    render->v_bars = calloc (MAX_FFT_SIZE, sizeof (double));
-    render->v_peaks = calloc (MAX_FFT_SIZE, sizeof (double));
-    render->delay_bars = calloc (MAX_FFT_SIZE, sizeof (int));
-    render->delay_peaks = calloc (MAX_FFT_SIZE, sizeof (int));
     render->pattern = NULL;
+    render->spectrogram = spectrogram_new ();
     return render;
 }
 
+int
+spectrum_buffers_reserve (w_spectrum_t *w, int num_bands)
+{
+    const int bins = MAX (config_get ()->fft_size / 2 + 1, w->buffer_bins);
+    num_bands = MAX (num_bands, w->buffer_bands);
+    if (bins == w->buffer_bins && num_bands == w->buffer_bands) {
+        return 0;
+    }
+
+    struct spectrum_data_t *d = w->data;
+    struct spectrum_render_t *r = w->render;
+    double **band_doubles[] = {
+        &d->frequency,
+        &r->amplitudes, &r->bars, &r->bars_peak, &r->peaks, &r->v_bars, &r->v_peaks,
+        &r->column_min, &r->column_max, &r->column_peak,
+    };
+    int **band_ints[] = {
+        &d->keys, &d->low_res_indices,
+        &r->delay_bars, &r->delay_peaks,
+    };
+    const int num_doubles = sizeof (band_doubles) / sizeof (band_doubles[0]);
+    const int num_ints = sizeof (band_ints) / sizeof (band_ints[0]);
+    const size_t size = spectrum_arena_align (bins * sizeof (double))
+        + spectrum_arena_align ((num_bands + 2) * sizeof (double))
+        + num_doubles * spectrum_arena_align (num_bands * sizeof (double))
+        + num_ints * spectrum_arena_align (num_bands * sizeof (int));
+
+    w->buffer_bins = 0;
+    w->buffer_bands = 0;
+    if (spectrum_arena_reserve (w->arena, size) != 0) {
+        return -1;
+    }
+    d->spectrum = spectrum_arena_alloc (w->arena, bins * sizeof (double));
+    d->low_res_values = spectrum_arena_alloc (w->arena, (num_bands + 2) * sizeof (double));
+    for (int i = 0; i < num_doubles; i++) {
+        *band_doubles[i] = spectrum_arena_alloc (w->arena, num_bands * sizeof (double));
+    }
+    for (int i = 0; i < num_ints; i++) {
+        *band_ints[i] = spectrum_arena_alloc (w->arena, num_bands * sizeof (int));
+    }
+    w->buffer_bins = bins;
+    w->buffer_bands = num_bands;
+    return 1;
+}
+
 static int
 get_db_range ()
 {
-    return config_get_int (ID_AMPLITUDE_MAX)- config_get_int (ID_AMPLITUDE_MIN);
+    return config_get ()->db_range;
 }
 
 static int
@@ -184,90 +149,8 @@ get_align_pos (int width, int spectrum_width)
     return left;
 }
 
-static uint32_t channel_list[] = {
-    DDB_SPEAKER_FRONT_LEFT,
-    DDB_SPEAKER_FRONT_RIGHT,
-    DDB_SPEAKER_FRONT_CENTER,
-    DDB_SPEAKER_LOW_FREQUENCY,
-    DDB_SPEAKER_BACK_LEFT,
-    DDB_SPEAKER_BACK_RIGHT,
-    DDB_SPEAKER_FRONT_LEFT_OF_CENTER,
-    DDB_SPEAKER_FRONT_RIGHT_OF_CENTER,
-    DDB_SPEAKER_BACK_CENTER,
-    DDB_SPEAKER_SIDE_LEFT,
-    DDB_SPEAKER_SIDE_RIGHT,
-    DDB_SPEAKER_TOP_CENTER,
-    DDB_SPEAKER_TOP_FRONT_LEFT,
-    DDB_SPEAKER_TOP_FRONT_CENTER,
-    DDB_SPEAKER_TOP_FRONT_RIGHT,
-    DDB_SPEAKER_TOP_BACK_LEFT,
-    DDB_SPEAKER_TOP_BACK_CENTER,
-    DDB_SPEAKER_TOP_BACK_RIGHT,
-    0,
-};
-
-static int
-skip_channel (int channel, int num_channels, uint32_t channel_mask)
-{
-    int ch_temp = 0;
-    int i = 0;
-    int ch_id = channel_list[i];
-    while (ch_id != 0) {
-        if (channel_mask & ch_id) {
-            if (ch_temp == channel) {
-                if (config_get_int (ID_CHANNEL) & ch_id) {
-                    return 0;
-                }
-                else {
-                    return 1;
-                }
-            }
-            ch_temp++;
-        }
-        i++;
-        ch_id = channel_list[i];
-    }
-
-    return 1;
-}
-
-static void
-do_fft (struct spectrum_data_t *s)
-{
-    if (!s->samples || !s->fft_plan) {
-        return;
-    }
-
-    deadbeef->mutex_lock (s->mutex);
-
-    const int fft_size = config_get_int (ID_FFT_SIZE);
-    for (int i = 0; i < fft_size; ++i) {
-        s->spectrum[i] = -DBL_MAX;
-    }
-
-    const double fft_squared = fft_size * fft_size;
-
-    for (int ch = 0; ch < s->num_channels; ++ch) {
-        if (skip_channel (ch, s->num_channels, s->channel_mask)) {
-            continue;
-        }
-        for (int i = 0; i < fft_size; i++) {
-            s->fft_in[i] = s->samples[i * s->num_channels + ch] * s->window[i];
-        }
-
-        fftw_execute (s->fft_plan);
-        for (int i = 0; i < fft_size/2; i++) {
-            const double real = s->fft_out[i][0];
-            const double imag = s->fft_out[i][1];
-            const double mag = 10.0 * log10 (4.0 * (real*real + imag*imag)/ fft_squared);
-            s->spectrum[i] = MAX (mag, s->spectrum[i]);
-        }
-    }
-    deadbeef->mutex_unlock (s->mutex);
-}
-
 static inline double
-spectrum_get_value (w_spectrum_t *w, int band, int num_bands)
+spectrum_get_value (w_spectrum_t *w, int band, int num_bands, int num_bins)
 {
     band = MAX (band, 1);
     const double k0 = w->data->keys[MAX(band - 1, 0)];
@@ -275,7 +158,7 @@ spectrum_get_value (w_spectrum_t *w, int band, int num_bands)
     const double k2 = w->data->keys[MIN(band + 1, num_bands -1)];
 
     const int start = ceil((k1 - k0)/2.0 + k0);
-    const int end = MIN (ceil((k2 - k1)/2.0 + k1), config_get_int (ID_FFT_SIZE)/2);
+    const int end = MIN (ceil((k2 - k1)/2.0 + k1), num_bins);
 
     if (start >= end) {
         return w->data->spectrum[end];
@@ -294,11 +177,12 @@ spectrum_band_gravity (double *peaks,
                        double d_velocity,
                        int *delays,
                        int delay,
+                       double interval,
                        int band)
 {
     if (peaks[band] > bars[band]) {
         if (delays[band] < 0) {
-            peaks[band] -= velocities[band] * config_get_int (ID_REFRESH_INTERVAL);
+            peaks[band] -= velocities[band] * interval;
             velocities[band] += d_velocity;
         }
         else {
@@ -314,31 +198,52 @@ spectrum_band_gravity (double *peaks,
 }
 
 static void
-spectrum_band_set (struct spectrum_render_t *r, int playback_status, double amplitude, int band)
+spectrum_band_set (struct spectrum_render_t *r, const struct spectrum_config_t *c, int playing, double amplitude, int band)
 {
-    r->bars[band] = CLAMP (amplitude - config_get_int (ID_AMPLITUDE_MIN), -DBL_MAX, get_db_range ());
+    const double bar_prev = MAX (r->bars[band], 0);
+    const double peak_prev = r->peaks[band];
+
+    r->bars[band] = CLAMP (amplitude - c->amp_min, -DBL_MAX, c->db_range);
 
-    const int state = deadbeef->get_output ()->state ();
-    if (state == OUTPUT_STATE_PLAYING) {
-        if (config_get_int (ID_ENABLE_PEAKS) && config_get_int (ID_PEAK_FALLOFF) != -1) {
+    if (playing) {
+        if (c->peaks) {
             // peak gravity
-            spectrum_band_gravity (r->peaks, r->bars, r->v_peaks, r->peak_velocity, r->delay_peaks, r->peak_delay, band);
+            spectrum_band_gravity (r->peaks, r->bars, r->v_peaks, r->peak_velocity, r->delay_peaks, r->peak_delay, r->interval, band);
         }
-        if (config_get_int (ID_ENABLE_AMPLITUDES) && config_get_int (ID_BAR_FALLOFF )!= -1) {
+        if (c->bar_gravity) {
             // bar gravity
-            spectrum_band_gravity (r->bars_peak, r->bars, r->v_bars, r->bar_velocity, r->delay_bars, r->bar_delay, band);
+            spectrum_band_gravity (r->bars_peak, r->bars, r->v_bars, r->bar_velocity, r->delay_bars, r->bar_delay, r->interval, band);
             r->bars[band] = r->bars_peak[band];
         }
     }
+    r->change += fabs (MAX (r->bars[band], 0) - bar_prev) + fabs (r->peaks[band] - peak_prev);
 }
 
+// Applies the physics to the levels in amplitudes
 static void
-spectrum_bands_fill (w_spectrum_t *w, int num_bands, int playback_status)
+spectrum_bands_update (w_spectrum_t *w, int num_bands, int playing)
 {
+    const struct spectrum_config_t *c = config_get ();
+    const gint64 start = spectrum_profile_begin ();
+    w->render->change = 0;
+    for (int i = 0; i < num_bands; i++) {
+        spectrum_band_set (w->render, c, playing, w->render->amplitudes[i], i);
+    }
+    w->render->change /= MAX (num_bands, 1);
+    spectrum_profile_end (w->profile, PROFILE_PHYSICS, start);
+}
+
+void
+spectrum_bands_fill (w_spectrum_t *w, int num_bands)
+{
+    const struct spectrum_config_t *c = config_get ();
+    const int playing = deadbeef->get_output ()->state () == OUTPUT_STATE_PLAYING;
     const int low_res_end = w->data->low_res_indices_num;
+    double *amplitudes = w->render->amplitudes;
+    gint64 start = spectrum_profile_begin ();
 
     int *x = w->data->low_res_indices;
-    double y[low_res_end + 1];
+    double *y = w->data->low_res_values;
 
     for (int i = 0; i <= low_res_end; i++) {
         y[i] = w->data->spectrum[w->data->keys[x[i]]];
@@ -346,32 +251,69 @@ spectrum_bands_fill (w_spectrum_t *w, int num_bands, int playback_status)
 
     int band = 0;
     // Interpolate
-    if (config_get_int (ID_INTERPOLATE)) {
+    if (c->interpolate) {
         for (int i = 0; i < low_res_end; i++) {
             const int i_end = MIN (i + 1, low_res_end - 1);
             for (int x_temp = x[i]; x_temp < x[i_end]; x_temp++) {
                 const double mu = (double)(x_temp - x[i]) / (double)(x[i_end] - x[i]);
-                const double amp = hermite_interpolate (y, mu, i-1, 0.35, 0);
-                spectrum_band_set (w->render, playback_status, amp, band++);
+                amplitudes[band++] = hermite_interpolate (y, mu, i-1, 0.35, 0);
             }
         }
     }
     // Fill the rest of the bands which don't need to be interpolated
     for (int i = band; i < num_bands; ++i) {
-        const double amp = spectrum_get_value (w, i, num_bands);
-        spectrum_band_set (w->render, playback_status, amp, i);
+        amplitudes[i] = spectrum_get_value (w, i, num_bands, c->fft_size/2);
+    }
+    spectrum_profile_end (w->profile, PROFILE_BANDS, start);
+
+    spectrum_bands_update (w, num_bands, playing);
+}
+
+// Follows the replay_file setting, returns 1 if the bands come from a
+// recording instead of the audio
+static int
+spectrum_replay_update (w_spectrum_t *w, int num_bands)
+{
+    const char *path = config_get_string (ID_STRING_REPLAY_FILE);
+    if (w->replay && (!path || strcmp (path, w->replay->path) != 0)) {
+        spectrum_replay_free (w->replay);
+        w->replay = NULL;
+    }
+    if (!path || !*path) {
+        return 0;
+    }
+    if (!w->replay) {
+        w->replay = spectrum_replay_new (path);
+        if (!w->replay) {
+            return 1;
+        }
+    }
+    const gint64 start = spectrum_profile_begin ();
+    const int res = spectrum_replay_fill (w->replay, g_get_monotonic_time (), w->render->amplitudes,
+                                          w->data->frequency, num_bands);
+    spectrum_profile_end (w->profile, PROFILE_BANDS, start);
+    if (res == 0) {
+        // the recording plays, whatever the player does
+        spectrum_bands_update (w, num_bands, 1);
     }
+    return 1;
 }
 
 static void
 spectrum_render (w_spectrum_t *w, int num_bands)
 {
+    if (spectrum_replay_update (w, num_bands)) {
+        return;
+    }
     if (w->playback_status != STOPPED) {
-        do_fft (w->data);
-        spectrum_bands_fill (w, num_bands, w->playback_status);
+        // Until the engine is set up the bands keep their state
+        if (spectrum_analysis_get (w->analysis, w->data->spectrum)) {
+            spectrum_bands_fill (w, num_bands);
+        }
     }
     else {
         struct spectrum_render_t *r = w->render;
+        r->change = 0;
         for (int i = 0; i < num_bands; i++) {
                 r->bars[i] = -DBL_MAX;
                 r->v_bars[i] = 0;
@@ -408,7 +350,7 @@ get_num_db_gridlines (void)
 }
 
 static void
-spectrum_draw_cairo_static (w_spectrum_t *w, cairo_t *cr, double note_width, int bands, cairo_rectangle_t *r)
+spectrum_draw_cairo_static (cairo_t *cr, double note_width, int bands, cairo_rectangle_t *r)
 {
     cairo_set_antialias (cr, CAIRO_ANTIALIAS_NONE);
     cairo_set_line_width (cr, 1);
@@ -464,23 +406,6 @@ spectrum_draw_cairo_static (w_spectrum_t *w, cairo_t *cr, double note_width, int
         }
         cairo_stroke (cr);
     }
-
-    // draw octave grid on hover
-    if (config_get_int (ID_ENABLE_OGRID) && w->motion_ctx.entered) {
-        const int dx = (int)(w->motion_ctx.x - r->x);
-        if (dx >= 0 && dx <= r->width) {
-            const int octave_offset = dx % (int)octave_width;
-            const int band_offset = dx % (int)note_width;
-            gdk_cairo_set_source_color (cr, config_get_color (ID_COLOR_OGRID));
-            double x = octave_offset + r->x - band_offset;
-            while (x <= r->width + r->x) {
-                cairo_move_to (cr, x, r->y);
-                cairo_rel_line_to (cr, 0, r->height);
-                x += octave_width;
-            }
-            cairo_stroke (cr);
-        }
-    }
 }
 
 static void
@@ -491,6 +416,19 @@ spectrum_background_draw (cairo_t *cr, double width, double height)
     cairo_fill (cr);
 }
 
+// Fills the widget around the given area, which holds a frame already
+static void
+spectrum_background_draw_around (cairo_t *cr, double width, double height, const cairo_rectangle_t *area)
+{
+    cairo_save (cr);
+    gdk_cairo_set_source_color (cr, config_get_color (ID_COLOR_BG));
+    cairo_set_fill_rule (cr, CAIRO_FILL_RULE_EVEN_ODD);
+    cairo_rectangle (cr, 0, 0, width, height);
+    cairo_rectangle (cr, area->x, area->y, area->width, area->height);
+    cairo_fill (cr);
+    cairo_restore (cr);
+}
+
 static double
 spectrum_amp_scale_get (const double height)
 {
@@ -498,19 +436,20 @@ spectrum_amp_scale_get (const double height)
 }
 
 static void
-spectrum_draw_peaks (struct spectrum_render_t *render, cairo_t *cr, cairo_rectangle_t *r, const int bar_width,
-                     const int peak_width, const int num_bands, const double amp_scale, const double bar_offset)
+spectrum_draw_peaks (double *peaks, cairo_t *cr, cairo_rectangle_t *r, const double bar_width,
+                     const double peak_width, const int num_bands, const double amp_scale, const double bar_offset)
 {
-    if (config_get_int (ID_ENABLE_PEAKS) && config_get_int (ID_PEAK_FALLOFF) >= 0) {
-        if (config_get_int (ID_ENABLE_PEAKS_COLOR)) {
+    const struct spectrum_config_t *c = config_get ();
+    if (c->peaks) {
+        if (c->peaks_color) {
             gdk_cairo_set_source_color (cr, config_get_color (ID_COLOR_PEAKS));
         }
         double x = r->x;
         for (int i = 0; i < num_bands; i++, x += bar_width) {
-            if (render->peaks[i] <= 0) {
+            if (peaks[i] <= 0) {
                 continue;
             }
-            const double y = r->y + CLAMP (r->height - render->peaks[i] * amp_scale, 0, r->height - 1);
+            const double y = r->y + CLAMP (r->height - peaks[i] * amp_scale, 0, r->height - 1);
             cairo_move_to (cr, x + bar_offset, y); 
             cairo_rel_line_to (cr, peak_width, 0);
         }
@@ -524,6 +463,7 @@ spectrum_draw_cairo_bars (struct spectrum_render_t *render, cairo_t *cr, int num
     if (r->height <= 0) {
         return;
     }
+    const struct spectrum_config_t *c = config_get ();
     cairo_set_antialias (cr, CAIRO_ANTIALIAS_NONE);
     cairo_set_line_width (cr, 1);
     const double amp_scale = spectrum_amp_scale_get (r->height);
@@ -535,16 +475,16 @@ spectrum_draw_cairo_bars (struct spectrum_render_t *render, cairo_t *cr, int num
 
     double x = r->x;
     double bar_width = barw;
-    if (config_get_int (ID_GAPS) && barw > 1) {
+    if (c->gaps && barw > 1) {
         bar_width -= 1;
     }
     double bar_offset = 0;
-    if (config_get_int (ID_SPACING) && bar_width > 4) {
+    if (c->spacing && bar_width > 4) {
         bar_offset = 1;
         bar_width -= 2;
     }
 
-    if (config_get_int (ID_ENABLE_BAR_MODE)) { 
+    if (c->bar_mode) {
         for (int i = 0; i < num_bars; i++, x += barw) {
             const int y0 = r->y + r->height;
             for (int y = y0; y > y0 - render->bars[i] * amp_scale; y -= 2) {
@@ -562,7 +502,7 @@ spectrum_draw_cairo_bars (struct spectrum_render_t *render, cairo_t *cr, int num
             cairo_rectangle (cr, x + bar_offset, r->y + r->height - 1, bar_width, - render->bars[i] * amp_scale);
         }
 
-        if (config_get_int (ID_FILL_SPECTRUM)) {
+        if (c->fill) {
             cairo_fill (cr);
         }
         else {
@@ -571,40 +511,89 @@ spectrum_draw_cairo_bars (struct spectrum_render_t *render, cairo_t *cr, int num
     }
 
     // draw peaks
-    spectrum_draw_peaks (render, cr, r, barw, bar_width, num_bars, amp_scale, bar_offset);
+    spectrum_draw_peaks (render->peaks, cr, r, barw, bar_width, num_bars, amp_scale, bar_offset);
+}
+
+// Reduces the bands to one min/max pair per pixel column, if there are more
+// bands than columns. Returns the number of columns.
+static int
+spectrum_columns_fill (struct spectrum_render_t *render, int bands, int width)
+{
+    if (bands <= width) {
+        for (int i = 0; i < bands; i++) {
+            const double v = MAX (render->bars[i], 0);
+            render->column_min[i] = v;
+            render->column_max[i] = v;
+            render->column_peak[i] = render->peaks[i];
+        }
+        return bands;
+    }
+
+    for (int c = 0; c < width; c++) {
+        const int start = (int)((int64_t)c * bands / width);
+        const int end = (int)((int64_t)(c + 1) * bands / width);
+        double v_min = DBL_MAX;
+        double v_max = 0;
+        double peak = 0;
+        for (int i = start; i < end; i++) {
+            const double v = MAX (render->bars[i], 0);
+            v_min = MIN (v_min, v);
+            v_max = MAX (v_max, v);
+            peak = MAX (peak, render->peaks[i]);
+        }
+        render->column_min[c] = v_min;
+        render->column_max[c] = v_max;
+        render->column_peak[c] = peak;
+    }
+    return width;
 }
 
 static void
-spectrum_draw_cairo (struct spectrum_render_t *render, cairo_t *cr, int bands, cairo_rectangle_t *r)
+spectrum_draw_cairo (struct spectrum_render_t *render, cairo_t *cr, int bands, double scale, cairo_rectangle_t *r)
 {
-    if (r->height <= 0) {
+    if (r->height <= 0 || r->width < 1) {
         return;
     }
     const double amp_scale = spectrum_amp_scale_get (r->height);
-    const int barw = CLAMP (floor(r->width / bands), 2, 20) - 1;
+    const int columns = spectrum_columns_fill (render, bands, (int)(r->width * scale));
+    const double column_width = r->width / columns;
+    const double y0 = r->y + r->height;
+    const int fill = config_get ()->fill;
 
     // draw spectrum
     cairo_set_source (cr, render->pattern);
 
     cairo_set_antialias (cr, CAIRO_ANTIALIAS_DEFAULT);
     cairo_set_line_width (cr, 1);
-    cairo_move_to (cr, r->x, r->height);
-    double py = r->height - amp_scale * render->bars[0];
-    cairo_rel_line_to (cr, 0, py);
-    for (gint i = 0; i < bands; i++)
-    {
-        const double x = r->x + barw * i;
-        const double y = r->height - amp_scale * MAX (render->bars[i],0);
 
-        if (!config_get_int (ID_FILL_SPECTRUM)) {
-            cairo_move_to (cr, x - 0.5, py);
+    double py = y0 - amp_scale * render->column_max[0];
+    cairo_move_to (cr, r->x, fill ? y0 : py);
+    for (int i = 0; i < columns; i++) {
+        // With fewer bands than pixels the outline interpolates between band centers
+        const double x = r->x + column_width * (i + 0.5);
+        const double y_max = y0 - amp_scale * render->column_max[i];
+        const double y_min = y0 - amp_scale * render->column_min[i];
+
+        // The area below the outline only depends on the maximum
+        if (fill || y_min == y_max) {
+            cairo_line_to (cr, x, y_max);
+            py = y_max;
+        }
+        // Visit the extreme closer to the previous point first to keep the outline short
+        else if (fabs (py - y_max) < fabs (py - y_min)) {
+            cairo_line_to (cr, x, y_max);
+            cairo_line_to (cr, x, y_min);
+            py = y_min;
+        }
+        else {
+            cairo_line_to (cr, x, y_min);
+            cairo_line_to (cr, x, y_max);
+            py = y_max;
         }
-        cairo_line_to (cr, x + 0.5, y);
-        py = y;
     }
-    if (config_get_int (ID_FILL_SPECTRUM)) {
-        cairo_line_to (cr, r->x + r->width, r->height);
-        cairo_rel_line_to (cr, r->width, 0);
+    if (fill) {
+        cairo_line_to (cr, r->x + r->width, py);
+        cairo_line_to (cr, r->x + r->width, y0);
 
         cairo_close_path (cr);
         cairo_fill (cr);
@@ -613,7 +602,25 @@ spectrum_draw_cairo (struct spectrum_render_t *render, cairo_t *cr, int bands, c
         cairo_stroke (cr);
     }
 
-    spectrum_draw_peaks (render, cr, r, barw, barw, bands, amp_scale, 0);
+    spectrum_draw_peaks (render->column_peak, cr, r, column_width, column_width, columns, amp_scale, 0);
+}
+
+static void
+spectrum_draw_spectrogram (w_spectrum_t *w, cairo_t *cr, struct spectrum_render_ctx_t *r_ctx)
+{
+    struct spectrum_spectrogram_t *sg = w->render->spectrogram;
+    const int history = config_get_int (ID_SPECTROGRAM_HISTORY);
+
+    // Without a configured history depth every pixel row shows one frame
+    spectrogram_resize (sg, r_ctx->num_bands, history > 0 ? history : (int)r_ctx->center.height);
+    // A row is a frame of the redraw timer, resizes or config changes draw
+    // extra frames which would add duplicate rows
+    const int ticks = __atomic_load_n (&w->frame_ticks, __ATOMIC_RELAXED);
+    if (ticks != w->spectrogram_ticks && (w->playback_status != STOPPED || w->replay)) {
+        spectrogram_push (sg, w->render->bars, get_db_range ());
+    }
+    w->spectrogram_ticks = ticks;
+    spectrogram_draw (sg, cr, &r_ctx->center);
 }
 
 static double
@@ -731,16 +738,11 @@ static int
 spectrum_bar_width_get (int num_bands, double width)
 {
     int barw = 0;
-    if (config_get_int (ID_DRAW_STYLE) == SOLID_STYLE) {
-        barw = 1;
+    if (config_get_int (ID_BAR_W) == 0) {
+        barw = CLAMP (width / num_bands, 2, 100);
     }
     else {
-        if (config_get_int (ID_BAR_W) == 0) {
-            barw = CLAMP (width / num_bands, 2, 100);
-        }
-        else {
-            barw = config_get_int (ID_BAR_W);
-        }
+        barw = config_get_int (ID_BAR_W);
     }
     return barw;
 }
@@ -766,88 +768,336 @@ spectrum_font_layout_get (cairo_t *cr, const enum spectrum_config_string_index i
     return layout;
 }
 
-static void
-spectrum_draw_tooltip (struct spectrum_render_t *render,
-                       struct spectrum_data_t *data,
-                       cairo_t *cr,
-                       struct spectrum_render_ctx_t *r_ctx,
-                       struct motion_context *m_ctx)
+// Area of the tooltip box for the given mouse position, its size is taken from the last drawn one
+static cairo_rectangle_t
+spectrum_tooltip_rect_get (struct spectrum_overlay_t *o, struct motion_context *m_ctx, double width, double height)
 {
-    cairo_rectangle_t *r = &r_ctx->center;
-
-    const double band_width = r_ctx->band_width;
-    const double note_width = r_ctx->note_width;
+    cairo_rectangle_t *r = &o->ctx.center;
+    const double padding = TOOLTIP_PADDING;
+    const double w_rect = width + 2 * padding;
+    const double h_rect = height + 2 * padding;
+    const double x = CLAMP (m_ctx->x + 20, r->x, r->x + r->width - w_rect);
+    const double y = CLAMP (m_ctx->y + 20, r->y, r->y + r->height - h_rect);
+
+    cairo_rectangle_t rect = {
+        .x = x - padding,
+        .y = y - padding,
+        .width = w_rect,
+        .height = h_rect,
+    };
+    return rect;
+}
 
-    const double x_bar = m_ctx->x - r->x;
-    const int pos = (int)floor(x_bar/note_width + config_get_int (ID_NOTE_MIN));
-    const int freq_pos = (int)(x_bar/band_width);
+static int
+spectrum_tooltip_band_get (struct spectrum_overlay_t *o, struct motion_context *m_ctx, int *note)
+{
+    struct spectrum_render_ctx_t *r_ctx = &o->ctx;
+    const double x_bar = m_ctx->x - r_ctx->center.x;
+    const int pos = (int)floor(x_bar/r_ctx->note_width + config_get_int (ID_NOTE_MIN));
+    const int freq_pos = (int)(x_bar/r_ctx->band_width);
 
     if (pos < config_get_int (ID_NOTE_MIN) || pos > config_get_int (ID_NOTE_MAX)
         || freq_pos < 0 || freq_pos >= r_ctx->num_bands) {
+        return -1;
+    }
+    *note = pos;
+    return freq_pos;
+}
+
+// Stores the part of rect inside the drawing area. A rect sticking out of it
+// would never be within the clip of a redraw and get queued over and over.
+static void
+spectrum_overlay_rect_add (struct spectrum_overlay_t *o, cairo_rectangle_t rect)
+{
+    const cairo_rectangle_t *a = &o->area;
+    const double x1 = MAX (rect.x, a->x);
+    const double y1 = MAX (rect.y, a->y);
+    const double x2 = MIN (rect.x + rect.width, a->x + a->width);
+    const double y2 = MIN (rect.y + rect.height, a->y + a->height);
+    if (x2 <= x1 || y2 <= y1 || o->num_rects >= MAX_OVERLAY_RECTS) {
+        return;
+    }
+    o->rects[o->num_rects++] = (cairo_rectangle_t){x1, y1, x2 - x1, y2 - y1};
+}
+
+static void
+spectrum_draw_tooltip (struct spectrum_overlay_t *o, cairo_t *cr, struct motion_context *m_ctx)
+{
+    int pos = 0;
+    const int freq_pos = spectrum_tooltip_band_get (o, m_ctx, &pos);
+    if (freq_pos < 0) {
         return;
     }
 
     char t1[100];
-    const double amp = render->bars[pos];
+    const double amp = o->bars[freq_pos];
     if (amp > -1000 && amp < 1000) {
-        snprintf (t1, sizeof (t1), "%.0f Hz (%s)\n%3.2f dB", data->frequency[freq_pos], spectrum_notes[pos], render->bars[pos] + config_get_int (ID_AMPLITUDE_MIN));
+        snprintf (t1, sizeof (t1), "%.0f Hz (%s)\n%3.2f dB", o->frequency[freq_pos], spectrum_notes[pos], amp + config_get_int (ID_AMPLITUDE_MIN));
     }
     else {
-        snprintf (t1, sizeof (t1), "%.0f Hz (%s)\n-inf dB", data->frequency[freq_pos], spectrum_notes[pos]);
+        snprintf (t1, sizeof (t1), "%.0f Hz (%s)\n-inf dB", o->frequency[freq_pos], spectrum_notes[pos]);
     }
 
     cairo_save (cr);
 
     PangoLayout *layout = spectrum_font_layout_get (cr, ID_STRING_FONT_TOOLTIP);
-    const double text_width = spectrum_pango_font_width (layout, t1);
-    const double text_height = spectrum_pango_font_height (layout, t1);
-
-    const double padding = 5;
-    double x = m_ctx->x + 20;
-    double y = m_ctx->y + 20;
-    const double w_rect = text_width + 2 * padding;
-    const double h_rect = text_height + 2 * padding;
-    y = CLAMP (y, r->y, r->y + r->height - h_rect);
-    x = CLAMP (x, r->x, r->x + r->width - w_rect);
-    const double x_rect = x - padding;
-    const double y_rect = y - padding;
+    o->tooltip_width = spectrum_pango_font_width (layout, t1);
+    o->tooltip_height = spectrum_pango_font_height (layout, t1);
+
+    const cairo_rectangle_t rect = spectrum_tooltip_rect_get (o, m_ctx, o->tooltip_width, o->tooltip_height);
 
     gdk_cairo_set_source_color (cr, config_get_color (ID_COLOR_BG));
-    cairo_rectangle (cr, x_rect, y_rect, w_rect, h_rect);
+    cairo_rectangle (cr, rect.x, rect.y, rect.width, rect.height);
     cairo_fill (cr);
 
     gdk_cairo_set_source_color (cr, config_get_color (ID_COLOR_TEXT));
     cairo_set_line_width (cr, 2.0);
-    cairo_rectangle (cr, x_rect, y_rect, w_rect, h_rect);
+    cairo_rectangle (cr, rect.x, rect.y, rect.width, rect.height);
     cairo_stroke (cr);
 
     gdk_cairo_set_source_color (cr, config_get_color (ID_COLOR_TEXT));
-    cairo_move_to (cr, x, y);
+    cairo_move_to (cr, rect.x + TOOLTIP_PADDING, rect.y + TOOLTIP_PADDING);
     pango_layout_set_text (layout, t1, -1);
     pango_cairo_show_layout (cr, layout);
 
     cairo_restore (cr);
 
     g_object_unref (layout);
+
+    // include the border line
+    spectrum_overlay_rect_add (o, (cairo_rectangle_t){rect.x - 1, rect.y - 1, rect.width + 2, rect.height + 2});
 }
 
-struct spectrum_render_ctx_t
-spectrum_get_render_ctx (cairo_t *cr, double width, double height)
+// Adds the octave grid lines for the given mouse position to the overlay rectangles
+// Position of the leftmost line of the octave grid through the hovered note,
+// returns -1 if the pointer isn't over the spectrum
+static double
+spectrum_ogrid_start (struct spectrum_overlay_t *o, struct motion_context *m_ctx, int *octave_width)
 {
-    PangoLayout *layout = spectrum_font_layout_get (cr, ID_STRING_FONT);
-    const double font_width = spectrum_font_width_max (layout);
-    const double font_height = spectrum_font_height_max (layout);
+    cairo_rectangle_t *r = &o->ctx.center;
+    const int note_width = (int)o->ctx.note_width;
+    *octave_width = (int)(o->ctx.note_width * NUM_NOTES_FOR_OCTAVE);
+    const int dx = (int)(m_ctx->x - r->x);
+    if (note_width <= 0 || dx < 0 || dx > r->width) {
+        return -1;
+    }
+    // start of the hovered note, the lines are whole octaves away from it
+    const int note_x = dx - dx % note_width;
+    return r->x + note_x % *octave_width;
+}
 
-    g_object_unref (layout);
+static void
+spectrum_ogrid_rects_add (struct spectrum_overlay_t *o, struct motion_context *m_ctx)
+{
+    cairo_rectangle_t *r = &o->ctx.center;
+    int octave_width = 0;
+    double x = spectrum_ogrid_start (o, m_ctx, &octave_width);
+    if (x < 0) {
+        return;
+    }
+    while (x <= r->width + r->x && o->num_rects < MAX_OVERLAY_RECTS - 1) {
+        spectrum_overlay_rect_add (o, (cairo_rectangle_t){floor (x) - 1, r->y, 3, r->height});
+        x += octave_width;
+    }
+}
 
-    const double label_height = font_height + FONT_PADDING_VERTICAL;
-    const double label_width = font_width + FONT_PADDING_HORIZONTAL;
+static void
+spectrum_draw_ogrid (struct spectrum_overlay_t *o, cairo_t *cr, struct motion_context *m_ctx)
+{
+    cairo_rectangle_t *r = &o->ctx.center;
+    int octave_width = 0;
+    double x = spectrum_ogrid_start (o, m_ctx, &octave_width);
+    if (x < 0) {
+        return;
+    }
+    spectrum_ogrid_rects_add (o, m_ctx);
+    cairo_save (cr);
+    cairo_set_antialias (cr, CAIRO_ANTIALIAS_NONE);
+    cairo_set_line_width (cr, 1);
+    gdk_cairo_set_source_color (cr, config_get_color (ID_COLOR_OGRID));
+    while (x <= r->width + r->x) {
+        cairo_move_to (cr, floor (x), r->y);
+        cairo_rel_line_to (cr, 0, r->height);
+        x += octave_width;
+    }
+    cairo_stroke (cr);
+    cairo_restore (cr);
+}
+
+struct spectrum_overlay_t *
+spectrum_overlay_new (void)
+{
+    struct spectrum_overlay_t *o = calloc (1, sizeof (struct spectrum_overlay_t));
+    o->mutex = deadbeef->mutex_create ();
+    return o;
+}
+
+void
+spectrum_overlay_free (struct spectrum_overlay_t *o)
+{
+    if (!o) {
+        return;
+    }
+    if (o->bars) {
+        free (o->bars);
+        o->bars = NULL;
+    }
+    if (o->frequency) {
+        free (o->frequency);
+        o->frequency = NULL;
+    }
+    if (o->mutex) {
+        deadbeef->mutex_free (o->mutex);
+        o->mutex = 0;
+    }
+    free (o);
+    o = NULL;
+}
+
+static void
+spectrum_overlay_publish (struct spectrum_overlay_t *o, struct spectrum_render_ctx_t *r_ctx, struct spectrum_render_t *render, struct spectrum_data_t *data)
+{
+    int num_bands = MIN (r_ctx->num_bands, MAX_BARS);
+    deadbeef->mutex_lock (o->mutex);
+    if (num_bands > o->capacity) {
+        double *bars = realloc (o->bars, num_bands * sizeof (double));
+        if (bars) {
+            o->bars = bars;
+        }
+        double *frequency = realloc (o->frequency, num_bands * sizeof (double));
+        if (frequency) {
+            o->frequency = frequency;
+        }
+        if (bars && frequency) {
+            o->capacity = num_bands;
+        }
+        num_bands = MIN (num_bands, o->capacity);
+    }
+    o->ctx = *r_ctx;
+    o->ctx.num_bands = num_bands;
+    memcpy (o->bars, render->bars, num_bands * sizeof (double));
+    memcpy (o->frequency, data->frequency, num_bands * sizeof (double));
+    deadbeef->mutex_unlock (o->mutex);
+}
+
+static void
+spectrum_overlay_queue_rects (GtkWidget *widget, cairo_rectangle_t *rects, int num_rects)
+{
+    for (int i = 0; i < num_rects; i++) {
+        cairo_rectangle_t *r = &rects[i];
+        gtk_widget_queue_draw_area (widget, floor (r->x), floor (r->y), ceil (r->width) + 1, ceil (r->height) + 1);
+    }
+}
+
+// Overlay rects are kept in widget coordinates, which start at the origin
+static cairo_rectangle_t
+spectrum_overlay_area (GtkWidget *widget)
+{
+    GtkAllocation a;
+    gtk_widget_get_allocation (widget, &a);
+    return (cairo_rectangle_t){0, 0, a.width, a.height};
+}
+
+void
+spectrum_overlay_invalidate (w_spectrum_t *w)
+{
+    struct spectrum_overlay_t *o = w->overlay;
+    deadbeef->mutex_lock (o->mutex);
+    o->area = spectrum_overlay_area (w->drawarea);
+    // Where the overlay has been drawn before
+    spectrum_overlay_queue_rects (w->drawarea, o->rects, o->num_rects);
+
+    // Where it's going to be drawn next
+    const int num_rects = o->num_rects;
+    if (w->motion_ctx.entered) {
+        if (config_get_int (ID_ENABLE_OGRID)) {
+            spectrum_ogrid_rects_add (o, &w->motion_ctx);
+        }
+        if (config_get_int (ID_ENABLE_TOOLTIP) && o->num_rects < MAX_OVERLAY_RECTS) {
+            if (o->tooltip_width > 0) {
+                cairo_rectangle_t rect = spectrum_tooltip_rect_get (o, &w->motion_ctx, o->tooltip_width, o->tooltip_height);
+                spectrum_overlay_rect_add (o, (cairo_rectangle_t){rect.x - 1, rect.y - 1, rect.width + 2, rect.height + 2});
+            }
+            else {
+                spectrum_overlay_rect_add (o, o->ctx.center);
+            }
+        }
+    }
+    spectrum_overlay_queue_rects (w->drawarea, o->rects + num_rects, o->num_rects - num_rects);
+    o->num_rects = num_rects;
+    deadbeef->mutex_unlock (o->mutex);
+}
+
+static int
+spectrum_rect_contains (cairo_rectangle_t *outer, cairo_rectangle_t *inner)
+{
+    return inner->x >= outer->x && inner->y >= outer->y
+        && inner->x + inner->width <= outer->x + outer->width
+        && inner->y + inner->height <= outer->y + outer->height;
+}
+
+static void
+spectrum_draw_overlay (w_spectrum_t *w, cairo_t *cr)
+{
+    struct spectrum_overlay_t *o = w->overlay;
+    deadbeef->mutex_lock (o->mutex);
+    o->area = spectrum_overlay_area (w->drawarea);
+    o->num_rects = 0;
+    if (w->motion_ctx.entered) {
+        const gint64 start = spectrum_profile_begin ();
+        if (config_get_int (ID_ENABLE_OGRID)) {
+            spectrum_draw_ogrid (o, cr, &w->motion_ctx);
+        }
+        if (config_get_int (ID_ENABLE_TOOLTIP) && o->num_rects < MAX_OVERLAY_RECTS) {
+            spectrum_draw_tooltip (o, cr, &w->motion_ctx);
+        }
+        spectrum_profile_end (w->profile, PROFILE_TOOLTIP, start);
+    }
+
+    // The size of the tooltip might have changed since it was invalidated,
+    // make sure it doesn't get cut off
+    double x1, y1, x2, y2;
+    cairo_clip_extents (cr, &x1, &y1, &x2, &y2);
+    cairo_rectangle_t clip = {x1, y1, x2 - x1, y2 - y1};
+    for (int i = 0; i < o->num_rects; i++) {
+        if (!spectrum_rect_contains (&clip, &o->rects[i])) {
+            spectrum_overlay_queue_rects (w->drawarea, &o->rects[i], 1);
+        }
+    }
+    deadbeef->mutex_unlock (o->mutex);
+}
+
+struct spectrum_render_ctx_t
+spectrum_get_render_ctx (struct spectrum_render_t *render, cairo_t *cr, double width, double height, int samplerate)
+{
+    // Creating a layout allocates, the labels only change with the static layer
+    if (!render->label_font_valid) {
+        PangoLayout *layout = spectrum_font_layout_get (cr, ID_STRING_FONT);
+        render->label_font_width = spectrum_font_width_max (layout);
+        render->label_font_height = spectrum_font_height_max (layout);
+        render->label_font_valid = 1;
+        g_object_unref (layout);
+    }
+
+    const double label_height = render->label_font_height + FONT_PADDING_VERTICAL;
+    const double label_width = render->label_font_width + FONT_PADDING_HORIZONTAL;
 
     const double labels_width = (config_get_int (ID_ENABLE_RIGHT_LABELS) + config_get_int (ID_ENABLE_LEFT_LABELS)) * label_width;
     const double spectrum_width_max = width - labels_width;
-    const int num_bands = get_num_bars (spectrum_width_max);
-    const int bar_width = spectrum_bar_width_get (num_bands, spectrum_width_max);
-    const double spectrum_width = bar_width * num_bands;
+    double scale = 1;
+    cairo_surface_get_device_scale (cairo_get_target (cr), &scale, NULL);
+    const int num_bands = get_num_bars (spectrum_width_max * scale, samplerate);
+    double spectrum_width = 0;
+    double band_width = 0;
+    if (config_get ()->draw_style == MUSICAL_STYLE) {
+        band_width = spectrum_bar_width_get (num_bands, spectrum_width_max);
+        spectrum_width = band_width * num_bands;
+    }
+    else {
+        // Bands are resampled to the full width
+        spectrum_width = MAX (floor (spectrum_width_max), 1);
+        band_width = spectrum_width / num_bands;
+    }
     const int x_start = get_align_pos (width, spectrum_width + labels_width);
 
     cairo_rectangle_t left, right, top, bottom, center;
@@ -877,8 +1127,9 @@ spectrum_get_render_ctx (cairo_t *cr, double width, double height)
     right.y = center.y;
 
     struct spectrum_render_ctx_t r_ctx = {
+        .scale = scale,
         .num_bands = num_bands,
-        .band_width = bar_width,
+        .band_width = band_width,
         .note_width = spectrum_width / (double)(get_num_notes ()),
         .right = right,
         .left = left,
@@ -890,84 +1141,331 @@ spectrum_get_render_ctx (cairo_t *cr, double width, double height)
     return r_ctx;
 }
 
-int
-draw_labels (cairo_t *cr, int width, int height)
+static void
+spectrum_static_layer_draw (cairo_t *cr, struct spectrum_render_ctx_t *r_ctx, int width, int height, struct spectrum_profile_t *profile)
 {
-    double x1, y1, x2, y2;
-    cairo_clip_extents (cr, &x1, &y1, &x2, &y2);
+    spectrum_background_draw (cr, width, height);
 
-    const int clip_width = x2 - x1;
-    const int clip_height = y2 - y1;
+    if (config_get ()->draw_style != SPECTROGRAM_STYLE) {
+        spectrum_draw_cairo_static (cr, r_ctx->note_width, r_ctx->num_bands, &r_ctx->center);
+    }
 
-    if (clip_width != width || clip_height != height) {
+    const gint64 start = spectrum_profile_begin ();
+    PangoLayout *layout = spectrum_font_layout_get (cr, ID_STRING_FONT);
+    if (config_get_int (ID_ENABLE_TOP_LABELS)) {
+        spectrum_draw_labels_freq (cr, layout, r_ctx, &r_ctx->top);
+    }
+    if (config_get_int (ID_ENABLE_BOTTOM_LABELS)) {
+        spectrum_draw_labels_freq (cr, layout, r_ctx, &r_ctx->bottom);
+    }
+    if (config_get_int (ID_ENABLE_LEFT_LABELS)) {
+        spectrum_draw_labels_db (cr, layout, &r_ctx->left);
+    }
+    if (config_get_int (ID_ENABLE_RIGHT_LABELS)) {
+        spectrum_draw_labels_db (cr, layout, &r_ctx->right);
+    }
+    g_object_unref (layout);
+    layout = NULL;
+    spectrum_profile_end (profile, PROFILE_LABELS, start);
+}
+
+// Recreates the static layer at the device scale of the target surface
+static void
+spectrum_static_layer_update (struct spectrum_render_t *render, struct spectrum_render_ctx_t *r_ctx, int width, int height, struct spectrum_profile_t *profile)
+{
+    const gint64 start = spectrum_profile_begin ();
+    if (render->static_layer) {
+        cairo_surface_destroy (render->static_layer);
+        render->static_layer = NULL;
+    }
+    render->static_layer = cairo_image_surface_create (CAIRO_FORMAT_RGB24, ceil (width * r_ctx->scale), ceil (height * r_ctx->scale));
+    cairo_surface_set_device_scale (render->static_layer, r_ctx->scale, r_ctx->scale);
+
+    cairo_t *static_cr = cairo_create (render->static_layer);
+    spectrum_static_layer_draw (static_cr, r_ctx, width, height, profile);
+    cairo_destroy (static_cr);
+    cairo_surface_flush (render->static_layer);
+    spectrum_profile_end (profile, PROFILE_STATIC, start);
+}
+
+static int
+spectrum_static_layer_valid (struct spectrum_render_t *render, int width, int height, double scale)
+{
+    if (!render->static_layer) {
         return 0;
     }
-    return 1;
+    double layer_scale = 1;
+    cairo_surface_get_device_scale (render->static_layer, &layer_scale, NULL);
+    return layer_scale == scale
+        && cairo_image_surface_get_width (render->static_layer) == (int)ceil (width * scale)
+        && cairo_image_surface_get_height (render->static_layer) == (int)ceil (height * scale);
 }
 
-gboolean
-spectrum_draw (GtkWidget *widget, cairo_t *cr, gpointer user_data) {
-    w_spectrum_t *w = user_data;
+// Follows the setting and the instance of the config, then publishes the bands
+static void
+spectrum_shm_update (w_spectrum_t *w, int num_bands)
+{
+    const int instance = w->config->instance;
+    if (w->shm && (!config_get_int (ID_SHARED_MEMORY) || w->shm->instance != instance)) {
+        spectrum_shm_writer_free (w->shm);
+        w->shm = NULL;
+    }
+    if (!config_get_int (ID_SHARED_MEMORY)) {
+        return;
+    }
+    if (!w->shm) {
+        w->shm = spectrum_shm_writer_new (instance);
+    }
+    const struct spectrum_config_t *c = config_get ();
+    spectrum_shm_publish (w->shm, w->render->bars, w->render->peaks, w->data->frequency,
+                          num_bands, w->samplerate, c->amp_min, c->amp_max);
+}
 
-    GtkAllocation a;
-    gtk_widget_get_allocation (w->drawarea, &a);
-    const int width = a.width;
-    const int height = a.height;
+// Same for the socket, the setting is the number of bits per band
+static void
+spectrum_stream_update (w_spectrum_t *w, int num_bands)
+{
+    const int instance = w->config->instance;
+    const int bits = config_get_int (ID_SOCKET_STREAM);
+    if (w->stream && (bits <= 0 || w->stream->instance != instance)) {
+        spectrum_stream_free (w->stream);
+        w->stream = NULL;
+    }
+    if (bits <= 0) {
+        return;
+    }
+    if (!w->stream) {
+        w->stream = spectrum_stream_new (instance);
+    }
+    const struct spectrum_config_t *c = config_get ();
+    spectrum_stream_publish (w->stream, bits, w->render->bars, num_bands, w->samplerate, c->amp_min, c->amp_max);
+}
 
-    struct spectrum_render_ctx_t r_ctx = spectrum_get_render_ctx (cr, width, height);
-    w->spectrum_rectangle = r_ctx.center;
+// Hands the frame to other plugins, once one of them asked for it
+static void
+spectrum_api_update (w_spectrum_t *w, int num_bands)
+{
+    if (!spectrum_api_used ()) {
+        return;
+    }
+    if (!w->publisher) {
+        w->publisher = spectrum_api_publisher_new ();
+        if (!w->publisher) {
+            return;
+        }
+    }
+    const struct spectrum_config_t *c = config_get ();
+    // The buffers only ever grow, the spectrum of this FFT size is the start of them
+    const int num_bins = c->fft_size / 2 + 1;
+    struct spectrum_api_frame_t *f = spectrum_api_frame_begin (w->publisher, num_bins, num_bands);
+    if (!f) {
+        return;
+    }
+    memcpy (f->spectrum, w->data->spectrum, num_bins * sizeof (double));
+    memcpy (f->frequency, w->data->frequency, num_bands * sizeof (double));
+    for (int i = 0; i < num_bands; i++) {
+        f->bands[i] = MAX (w->render->bars[i], 0) + c->amp_min;
+        f->peaks[i] = MAX (w->render->peaks[i], 0) + c->amp_min;
+    }
+    f->frame.samplerate = w->samplerate;
+    f->frame.fft_size = c->fft_size;
+    f->frame.amp_min = c->amp_min;
+    f->frame.amp_max = c->amp_max;
+    spectrum_api_frame_commit (w->publisher, f, w->config->instance);
+}
 
-    if (width != w->prev_width || w->need_redraw) {
-        if (w->need_redraw == 1) {
-            w->need_redraw = 0;
+// Appends the frame to the file of the record_file setting while playing
+static void
+spectrum_record_update (w_spectrum_t *w, int num_bands)
+{
+    const char *path = config_get_string (ID_STRING_RECORD_FILE);
+    if (w->recorder && (!path || strcmp (path, w->recorder->path) != 0)) {
+        spectrum_recorder_free (w->recorder);
+        w->recorder = NULL;
+    }
+    if (!path || !*path || w->playback_status == STOPPED) {
+        return;
+    }
+    if (!w->recorder) {
+        w->recorder = spectrum_recorder_new (path);
+        if (!w->recorder) {
+            return;
         }
+    }
+    const struct spectrum_config_t *c = config_get ();
+    spectrum_recorder_append (w->recorder, w->render->amplitudes, w->render->peaks, w->data->frequency, num_bands,
+                              w->samplerate, c->fft_size, w->render->interval, c->amp_min, c->amp_max);
+}
+
+// Writes the statistics for the performance overlay, called by the render
+// worker at the end of a frame
+static void
+spectrum_hud_update (w_spectrum_t *w)
+{
+    char text[WORKER_STATS_SIZE] = {};
+    int len = snprintf (text, sizeof (text), "%-8s %7s %7s %7s %7s", "µs", "p50", "p95", "p99", "max");
+
+    // Ingest and FFT are timed by the analysis engine
+    for (int i = 0; i < NUM_PROFILE_STAGE && len < sizeof (text); i++) {
+        struct spectrum_profile_t *p = (i == PROFILE_INGEST || i == PROFILE_FFT) ? w->analysis->profile : w->profile;
+        struct spectrum_profile_stats_t stats;
+        spectrum_profile_stats_get (p, i, &stats);
+        len += snprintf (text + len, sizeof (text) - len, "\n%-8s %7.0f %7.0f %7.0f %7.0f",
+                         spectrum_profile_stage_names[i], stats.p50, stats.p95, stats.p99, stats.max);
+    }
+    const size_t buffers = w->arena->size;
+    size_t layer = 0;
+    if (w->render->static_layer) {
+        layer = (size_t)cairo_image_surface_get_stride (w->render->static_layer)
+            * cairo_image_surface_get_height (w->render->static_layer);
+    }
+    const size_t analysis = spectrum_analysis_memory (w->analysis);
+    if (len < sizeof (text)) {
+        len += snprintf (text + len, sizeof (text) - len, "\nmemory KiB: %zu buffers, %zu layer, %zu analysis",
+                         buffers / 1024, layer / 1024, analysis / 1024);
+    }
+
+    deadbeef->mutex_lock (w->profile->mutex);
+    const uint64_t frames = w->profile->frames;
+    const uint64_t late_frames = w->profile->late_frames;
+    deadbeef->mutex_unlock (w->profile->mutex);
+    if (len < sizeof (text)) {
+        snprintf (text + len, sizeof (text) - len, "\nlate frames %llu of %llu (> %d ms)",
+                  (unsigned long long)late_frames, (unsigned long long)frames, config_get_int (ID_REFRESH_INTERVAL));
+    }
+    spectrum_worker_stats_set (w->worker, text);
+}
+
+void
+spectrum_draw_frame (w_spectrum_t *w, cairo_t *cr, int width, int height)
+{
+    const gint64 frame_start = spectrum_profile_begin ();
+    unsigned int rebuild = w->need_redraw;
+    w->need_redraw = 0;
+    if (width != w->prev_width) {
+        rebuild |= CONFIG_CHANGED_BANDS | CONFIG_CHANGED_COLORS | CONFIG_CHANGED_STATIC;
+    }
+    else if (height != w->prev_height) {
+        rebuild |= CONFIG_CHANGED_COLORS;
+    }
+    if (rebuild & CONFIG_CHANGED_STATIC) {
+        w->render->label_font_valid = 0;
+    }
+    struct spectrum_render_ctx_t r_ctx = spectrum_get_render_ctx (w->render, cr, width, height, w->samplerate);
+
+    const int reserved = spectrum_buffers_reserve (w, r_ctx.num_bands);
+    if (reserved < 0) {
+        w->need_redraw = rebuild;
+        return;
+    }
+    if (reserved > 0) {
+        // the buffers have been replaced, the bands start from scratch
+        rebuild |= CONFIG_CHANGED_BANDS;
+    }
+    if (rebuild & CONFIG_CHANGED_BANDS) {
         create_frequency_table(w->data, w->samplerate, r_ctx.num_bands);
+    }
+    if (rebuild & CONFIG_CHANGED_COLORS) {
         if (w->render->pattern) {
             cairo_pattern_destroy (w->render->pattern);
             w->render->pattern = NULL;
         }
         w->render->pattern = spectrum_gradient_pattern_get (CONFIG_GRADIENT_COLORS, config_get_int (ID_GRADIENT_ORIENTATION), width, height);
+        spectrogram_colors_set (w->render->spectrogram, CONFIG_GRADIENT_COLORS, config_get_color (ID_COLOR_BG));
+    }
+    if (rebuild & CONFIG_CHANGED_STATIC || !spectrum_static_layer_valid (w->render, width, height, r_ctx.scale)) {
+        spectrum_static_layer_update (w->render, &r_ctx, width, height, w->profile);
     }
     w->prev_width = width;
     w->prev_height = height;
 
 
     spectrum_render (w, r_ctx.num_bands);
+    spectrum_shm_update (w, r_ctx.num_bands);
+    spectrum_stream_update (w, r_ctx.num_bands);
+    spectrum_api_update (w, r_ctx.num_bands);
+    spectrum_record_update (w, r_ctx.num_bands);
 
-    // draw background
-    spectrum_background_draw (cr, width, height);
+    // background, grid and labels
+    cairo_set_source_surface (cr, w->render->static_layer, 0, 0);
+    cairo_paint (cr);
 
-    spectrum_draw_cairo_static (w, cr, r_ctx.note_width, r_ctx.num_bands, &r_ctx.center);
-    if (config_get_int (ID_DRAW_STYLE) == MUSICAL_STYLE) {
+    const gint64 start = spectrum_profile_begin ();
+    const int style = config_get ()->draw_style;
+    if (style == SPECTROGRAM_STYLE) {
+        spectrum_draw_spectrogram (w, cr, &r_ctx);
+    }
+    else if (style == MUSICAL_STYLE) {
         spectrum_draw_cairo_bars (w->render, cr, r_ctx.num_bands, r_ctx.note_width, &r_ctx.center);
     }
-    else {
-        spectrum_draw_cairo (w->render, cr, r_ctx.num_bands, &r_ctx.center);
+    else if (style == SOLID_STYLE) {
+        spectrum_draw_cairo (w->render, cr, r_ctx.num_bands, r_ctx.scale, &r_ctx.center);
     }
+    spectrum_profile_end (w->profile, PROFILE_BARS, start);
 
-    if (draw_labels (cr, width, height)) {
-        PangoLayout *layout = spectrum_font_layout_get (cr, ID_STRING_FONT);
-        if (config_get_int (ID_ENABLE_TOP_LABELS)) {
-            spectrum_draw_labels_freq (cr, layout, &r_ctx, &r_ctx.top);
-        }
-        if (config_get_int (ID_ENABLE_BOTTOM_LABELS)) {
-            spectrum_draw_labels_freq (cr, layout, &r_ctx, &r_ctx.bottom);
-        }
-        if (config_get_int (ID_ENABLE_LEFT_LABELS)) {
-            spectrum_draw_labels_db (cr, layout, &r_ctx.left);
-        }
-        if (config_get_int (ID_ENABLE_RIGHT_LABELS)) {
-            spectrum_draw_labels_db (cr, layout, &r_ctx.right);
-        }
-        g_object_unref (layout);
-        layout = NULL;
-
+    spectrum_overlay_publish (w->overlay, &r_ctx, w->render, w->data);
+    spectrum_profile_frame_end (w->profile, frame_start, config_get_int (ID_REFRESH_INTERVAL));
+    if (w->profile && __atomic_load_n (&w->hud, __ATOMIC_RELAXED)) {
+        spectrum_hud_update (w);
     }
+}
 
-    if (config_get_int (ID_ENABLE_TOOLTIP) && w->motion_ctx.entered) {
-        spectrum_draw_tooltip (w->render, w->data, cr, &r_ctx, &w->motion_ctx);
+// Timing statistics of the stages in the top left corner
+static void
+spectrum_draw_hud (w_spectrum_t *w, cairo_t *cr)
+{
+    // The worker writes the text after each frame, waiting for the frame in
+    // progress would stall the main thread and skew the numbers
+    char text[WORKER_STATS_SIZE];
+    spectrum_worker_stats_get (w->worker, text, sizeof (text));
+    if (!*text) {
+        return;
     }
 
+    PangoLayout *layout = pango_cairo_create_layout (cr);
+    PangoFontDescription *desc = pango_font_description_from_string ("Monospace 8");
+    pango_layout_set_font_description (layout, desc);
+    pango_font_description_free (desc);
+    desc = NULL;
+    pango_layout_set_text (layout, text, -1);
+
+    int text_width = 0;
+    int text_height = 0;
+    pango_layout_get_pixel_size (layout, &text_width, &text_height);
+    cairo_save (cr);
+    cairo_set_source_rgba (cr, 0, 0, 0, 0.75);
+    cairo_rectangle (cr, 0, 0, text_width + 2 * HUD_PADDING, text_height + 2 * HUD_PADDING);
+    cairo_fill (cr);
+    cairo_set_source_rgb (cr, 1, 1, 1);
+    cairo_move_to (cr, HUD_PADDING, HUD_PADDING);
+    pango_cairo_show_layout (cr, layout);
+    cairo_restore (cr);
+    g_object_unref (layout);
+    layout = NULL;
+}
+
+gboolean
+spectrum_draw (GtkWidget *widget, cairo_t *cr, gpointer user_data) {
+    w_spectrum_t *w = user_data;
+
+    GtkAllocation a;
+    gtk_widget_get_allocation (w->drawarea, &a);
+
+    const int scale = get_scale_factor (w->drawarea);
+
+    // Frames are drawn by the render worker, all we do here is to show the latest one.
+    // After a size or scale change a matching one gets requested, until it's
+    // there the old frame stays and only the area it doesn't cover gets cleared
+    cairo_rectangle_t frame;
+    if (!spectrum_worker_paint (w->worker, cr, a.width, a.height, scale, &frame)) {
+        spectrum_background_draw_around (cr, a.width, a.height, &frame);
+        spectrum_worker_request (w->worker, a.width, a.height, scale);
+    }
+    // Hover effects are drawn on top of it, without causing a new frame
+    spectrum_draw_overlay (w, cr);
+    if (w->hud) {
+        spectrum_draw_hud (w, cr);
+    }
     return FALSE;
 }
 
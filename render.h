@@ -1,8 +1,50 @@
 #pragma once
 
 #include <gtk/gtk.h>
+#include "spectrum.h"
+
+#define MAX_OVERLAY_RECTS 32
+
+struct spectrum_render_ctx_t {
+    // device pixels per logical pixel
+    double scale;
+    int num_bands;
+    double band_width;
+    double note_width;
+    // Spectrum rectangle
+    cairo_rectangle_t center;
+    // Left labels rectangle
+    cairo_rectangle_t left;
+    // Right labels rectangle
+    cairo_rectangle_t right;
+    // Top labels rectangle
+    cairo_rectangle_t top;
+    // Bottom labels rectangle
+    cairo_rectangle_t bottom;
+};
+
+// Hover effects (tooltip, octave grid), drawn on the main thread on top of the last frame
+struct spectrum_overlay_t {
+    // protects the fields below
+    intptr_t mutex;
+    // layout and bands of the last finished frame
+    struct spectrum_render_ctx_t ctx;
+    double *bars;
+    double *frequency;
+    // number of bands bars and frequency have room for
+    int capacity;
+    // allocation of the drawing area, the rects are clipped to it
+    cairo_rectangle_t area;
+    // area covered by the overlay when it was drawn the last time
+    cairo_rectangle_t rects[MAX_OVERLAY_RECTS];
+    int num_rects;
+    double tooltip_width;
+    double tooltip_height;
+};
 
 struct spectrum_render_t {
+    // amplitudes of the bands before the physics are applied
+    double *amplitudes;
     double *bars;
     double *bars_peak;
     double *peaks;
@@ -14,12 +56,40 @@ struct spectrum_render_t {
     int peak_delay;
     double bar_velocity;
     double peak_velocity;
+    // time between two rendered frames in ms
+    double interval;
+    // mean change of the displayed amplitudes in the last frame in dB
+    double change;
+    // bands reduced to pixel columns for the solid style
+    double *column_min;
+    double *column_max;
+    double *column_peak;
     cairo_pattern_t *pattern;
+    struct spectrum_spectrogram_t *spectrogram;
+    // background, grid and labels at device resolution, only redrawn when they change
+    cairo_surface_t *static_layer;
+    // size of the largest label, measured again when the static layer changes
+    double label_font_width;
+    double label_font_height;
+    int label_font_valid;
 };
 
 gboolean
 spectrum_draw (GtkWidget *widget, cairo_t *cr, gpointer user_data);
 
+void
+spectrum_draw_frame (w_spectrum_t *w, cairo_t *cr, int width, int height);
+
+// Maps the spectrum of the last frame to the bands, done by spectrum_draw_frame
+void
+spectrum_bands_fill (w_spectrum_t *w, int num_bands);
+
+// Makes the band buffers of data and render large enough for num_bands and
+// the FFT size of the config. They only grow and are cleared when they do.
+// Returns 1 if the buffers have been replaced, -1 if there is no memory.
+int
+spectrum_buffers_reserve (w_spectrum_t *w, int num_bands);
+
 struct spectrum_data_t *
 spectrum_data_new (void);
 
@@ -31,3 +101,12 @@ spectrum_render_new (void);
 
 void
 spectrum_render_free (struct spectrum_render_t *render);
+
+struct spectrum_overlay_t *
+spectrum_overlay_new (void);
+
+void
+spectrum_overlay_free (struct spectrum_overlay_t *o);
+
+void
+spectrum_overlay_invalidate (w_spectrum_t *w);
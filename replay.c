@@ -0,0 +1,181 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <gtk/gtk.h>
+
+#include "replay.h"
+
+// Used if the recording doesn't know its interval
+#define REPLAY_DEFAULT_HOP 25000
+
+static int
+spectrum_replay_valid (const struct spectrum_record_header_t *h, size_t size)
+{
+    if (size < sizeof (struct spectrum_record_header_t)
+        || h->magic != SPECTRUM_RECORD_MAGIC
+        || h->version != SPECTRUM_RECORD_VERSION
+        || h->num_bands == 0
+        || h->data_offset < sizeof (struct spectrum_record_header_t) + h->num_bands * sizeof (float)
+        || h->record_size < sizeof (struct spectrum_record_t) + 2 * h->num_bands * sizeof (float)
+        || h->num_records == 0) {
+        return 0;
+    }
+    // Written as a division, a bogus num_records would overflow the product
+    return h->data_offset <= size && h->num_records <= (size - h->data_offset) / h->record_size;
+}
+
+struct spectrum_replay_t *
+spectrum_replay_new (const char *path)
+{
+    struct spectrum_replay_t *replay = calloc (1, sizeof (struct spectrum_replay_t));
+    if (!replay) {
+        return NULL;
+    }
+    replay->path = g_strdup (path);
+    replay->start = -1;
+
+    const int fd = open (path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat (fd, &st) != 0) {
+        fprintf (stderr, "musical spectrum: failed to open recording %s\n", path);
+        if (fd >= 0) {
+            close (fd);
+        }
+        return replay;
+    }
+    void *map = st.st_size > 0 ? mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close (fd);
+    if (map == MAP_FAILED) {
+        fprintf (stderr, "musical spectrum: failed to map recording %s\n", path);
+        return replay;
+    }
+    if (!spectrum_replay_valid (map, st.st_size)) {
+        fprintf (stderr, "musical spectrum: %s is not a recording\n", path);
+        munmap (map, st.st_size);
+        return replay;
+    }
+    replay->header = map;
+    replay->size = st.st_size;
+    // A recording which is still being written may grow, we stick to what
+    // was there when it was opened
+    replay->num_records = replay->header->num_records;
+    replay->hop = replay->header->hop > 0 ? replay->header->hop : REPLAY_DEFAULT_HOP;
+    // Frames are read at roughly the display rate, mostly in order
+    madvise (map, st.st_size, MADV_SEQUENTIAL);
+    return replay;
+}
+
+void
+spectrum_replay_free (struct spectrum_replay_t *replay)
+{
+    if (!replay) {
+        return;
+    }
+    if (replay->header) {
+        munmap ((void *)replay->header, replay->size);
+        replay->header = NULL;
+    }
+    free (replay->band_map);
+    replay->band_map = NULL;
+    g_free (replay->path);
+    replay->path = NULL;
+    free (replay);
+    replay = NULL;
+}
+
+void
+spectrum_replay_seek (struct spectrum_replay_t *replay, uint64_t index)
+{
+    if (!replay->header) {
+        return;
+    }
+    replay->position = index % replay->num_records;
+    // the clock picks up from here with the next frame
+    replay->start = -1;
+}
+
+// Maps each band of the widget to the recorded band closest in frequency,
+// both are in ascending order
+static int
+spectrum_replay_map_bands (struct spectrum_replay_t *replay, const double *frequency, int num_bands)
+{
+    if (replay->mapped_bands == num_bands && num_bands > 0
+        && replay->mapped_low == frequency[0] && replay->mapped_high == frequency[num_bands - 1]) {
+        return 0;
+    }
+    if (num_bands > replay->band_map_size) {
+        int *band_map = realloc (replay->band_map, num_bands * sizeof (int));
+        if (!band_map) {
+            return -1;
+        }
+        replay->band_map = band_map;
+        replay->band_map_size = num_bands;
+    }
+    const float *recorded = spectrum_record_frequency (replay->header);
+    const int num_recorded = replay->header->num_bands;
+    int j = 0;
+    for (int i = 0; i < num_bands; i++) {
+        while (j < num_recorded - 1 && fabs (recorded[j + 1] - frequency[i]) <= fabs (recorded[j] - frequency[i])) {
+            j++;
+        }
+        replay->band_map[i] = j;
+    }
+    replay->mapped_bands = num_bands;
+    replay->mapped_low = num_bands > 0 ? frequency[0] : 0;
+    replay->mapped_high = num_bands > 0 ? frequency[num_bands - 1] : 0;
+    return 0;
+}
+
+int
+spectrum_replay_fill (struct spectrum_replay_t *replay, int64_t now, double *levels,
+                      const double *frequency, int num_bands)
+{
+    if (!replay->header || spectrum_replay_map_bands (replay, frequency, num_bands) != 0) {
+        return -1;
+    }
+
+    if (replay->stepped) {
+        if (replay->start >= 0) {
+            replay->position = (replay->position + 1) % replay->num_records;
+        }
+        replay->start = 0;
+    }
+    else {
+        if (replay->start < 0) {
+            replay->start = now - (int64_t)replay->position * replay->hop;
+        }
+        replay->position = (uint64_t)MAX (now - replay->start, 0) / replay->hop % replay->num_records;
+    }
+
+    const struct spectrum_record_t *r = spectrum_record_get (replay->header, replay->position);
+    for (int i = 0; i < num_bands; i++) {
+        const float v = r->values[replay->band_map[i]];
+        levels[i] = v <= -FLT_MAX ? -DBL_MAX : v;
+    }
+    return 0;
+}
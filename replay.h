@@ -0,0 +1,70 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "spectrum_record.h"
+
+// Plays back a recording made with the recorder. The file is mapped, so any
+// frame is found by its index without reading the ones before it. Only used
+// by the render worker.
+struct spectrum_replay_t {
+    char *path;
+    // NULL if the file couldn't be mapped or isn't a recording
+    const struct spectrum_record_header_t *header;
+    size_t size;
+    // complete records when the file was opened
+    uint64_t num_records;
+    // interval between records in microseconds
+    int64_t hop;
+    // monotonic time at which record 0 is (or would have been) shown,
+    // -1 until the first frame
+    int64_t start;
+    // advance one record per frame instead of following the clock
+    int stepped;
+    uint64_t position;
+
+    // recorded band of each band of the widget
+    int *band_map;
+    int band_map_size;
+    int mapped_bands;
+    double mapped_low;
+    double mapped_high;
+};
+
+struct spectrum_replay_t *
+spectrum_replay_new (const char *path);
+
+void
+spectrum_replay_free (struct spectrum_replay_t *replay);
+
+// Continues playback at the given record, the recording loops
+void
+spectrum_replay_seek (struct spectrum_replay_t *replay, uint64_t index);
+
+// Fills the levels of the widget bands with the record due at time now, the
+// recorded bands are mapped to the closest ones by frequency. Returns 0 on
+// success, -1 without a valid recording or if out of memory.
+int
+spectrum_replay_fill (struct spectrum_replay_t *replay, int64_t now, double *levels,
+                      const double *frequency, int num_bands);
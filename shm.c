@@ -0,0 +1,108 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <gtk/gtk.h>
+
+#include "shm.h"
+
+struct spectrum_shm_writer_t *
+spectrum_shm_writer_new (int instance)
+{
+    struct spectrum_shm_writer_t *writer = calloc (1, sizeof (struct spectrum_shm_writer_t));
+    writer->instance = instance;
+    snprintf (writer->name, sizeof (writer->name), SPECTRUM_SHM_NAME, (unsigned int)getuid (), instance);
+
+    // A segment left behind by a crashed player is replaced, readers which
+    // still map it notice that it doesn't change any more
+    shm_unlink (writer->name);
+    const int fd = shm_open (writer->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        fprintf (stderr, "musical spectrum: failed to create shared memory %s\n", writer->name);
+        return writer;
+    }
+    if (ftruncate (fd, sizeof (struct spectrum_shm_t)) == 0) {
+        void *shm = mmap (NULL, sizeof (struct spectrum_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (shm != MAP_FAILED) {
+            writer->shm = shm;
+        }
+    }
+    close (fd);
+    if (!writer->shm) {
+        fprintf (stderr, "musical spectrum: failed to map shared memory %s\n", writer->name);
+        shm_unlink (writer->name);
+        return writer;
+    }
+    // The segment is zeroed, readers check the magic last
+    writer->shm->version = SPECTRUM_SHM_VERSION;
+    writer->shm->capacity = SPECTRUM_SHM_CAPACITY;
+    __atomic_store_n (&writer->shm->magic, SPECTRUM_SHM_MAGIC, __ATOMIC_RELEASE);
+    return writer;
+}
+
+void
+spectrum_shm_writer_free (struct spectrum_shm_writer_t *writer)
+{
+    if (!writer) {
+        return;
+    }
+    if (writer->shm) {
+        munmap (writer->shm, sizeof (struct spectrum_shm_t));
+        writer->shm = NULL;
+        shm_unlink (writer->name);
+    }
+    free (writer);
+    writer = NULL;
+}
+
+void
+spectrum_shm_publish (struct spectrum_shm_writer_t *writer, const double *bars, const double *peaks,
+                      const double *frequency, int num_bands, int samplerate, int amp_min, int amp_max)
+{
+    struct spectrum_shm_t *shm = writer->shm;
+    if (!shm) {
+        return;
+    }
+    num_bands = CLAMP (num_bands, 0, SPECTRUM_SHM_CAPACITY);
+
+    // Odd while writing, the fence keeps the data stores after it
+    const uint32_t seq = shm->seq;
+    __atomic_store_n (&shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+
+    for (int i = 0; i < num_bands; i++) {
+        shm->bands[i] = MAX (bars[i], 0) + amp_min;
+        shm->peaks[i] = MAX (peaks[i], 0) + amp_min;
+        shm->frequency[i] = frequency[i];
+    }
+    shm->info.frame = ++writer->frame;
+    shm->info.timestamp = g_get_monotonic_time ();
+    shm->info.num_bands = num_bands;
+    shm->info.samplerate = samplerate;
+    shm->info.amp_min = amp_min;
+    shm->info.amp_max = amp_max;
+
+    __atomic_store_n (&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,46 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include "spectrum_shm.h"
+
+// Publishes the bands of every frame to a shared memory segment, the layout
+// and the reading side are described in spectrum_shm.h
+struct spectrum_shm_writer_t {
+    int instance;
+    char name[64];
+    // NULL if the segment couldn't be created
+    struct spectrum_shm_t *shm;
+    uint64_t frame;
+};
+
+// Creates the segment of the instance, replacing a stale one of the same name
+struct spectrum_shm_writer_t *
+spectrum_shm_writer_new (int instance);
+
+// Unmaps and removes the segment
+void
+spectrum_shm_writer_free (struct spectrum_shm_writer_t *writer);
+
+// Levels and peaks are relative to amp_min, as the render state keeps them
+void
+spectrum_shm_publish (struct spectrum_shm_writer_t *writer, const double *bars, const double *peaks,
+                      const double *frequency, int num_bands, int samplerate, int amp_min, int amp_max);
@@ -0,0 +1,177 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gtk/gtk.h>
+
+#include "spectrogram.h"
+
+static uint32_t
+rgb_from_color (double r, double g, double b)
+{
+    return ((uint32_t)(r * 255) << 16) | ((uint32_t)(g * 255) << 8) | (uint32_t)(b * 255);
+}
+
+struct spectrum_spectrogram_t *
+spectrogram_new (void)
+{
+    struct spectrum_spectrogram_t *sg = calloc (1, sizeof (struct spectrum_spectrogram_t));
+    return sg;
+}
+
+void
+spectrogram_free (struct spectrum_spectrogram_t *sg)
+{
+    if (!sg) {
+        return;
+    }
+    if (sg->surface) {
+        cairo_surface_destroy (sg->surface);
+        sg->surface = NULL;
+    }
+    free (sg);
+    sg = NULL;
+}
+
+void
+spectrogram_colors_set (struct spectrum_spectrogram_t *sg, GList *colors, GdkColor *background)
+{
+    const double d = 65535.0;
+    sg->background = rgb_from_color (background->red / d, background->green / d, background->blue / d);
+
+    const int num_colors = g_list_length (colors);
+    if (num_colors == 0) {
+        for (int i = 0; i < GRADIENT_TABLE_SIZE; i++) {
+            sg->colors[i] = sg->background;
+        }
+        return;
+    }
+
+    // The first gradient color is used for the loudest amplitudes, just like
+    // in the vertical gradient of the other styles
+    GdkColor *stops[num_colors];
+    int n = 0;
+    for (GList *c = colors; c != NULL; c = c->next) {
+        stops[n++] = c->data;
+    }
+
+    for (int i = 0; i < GRADIENT_TABLE_SIZE; i++) {
+        const double pos = (1.0 - i / (double)(GRADIENT_TABLE_SIZE - 1)) * (num_colors - 1);
+        const int c0 = MIN ((int)pos, num_colors - 1);
+        const int c1 = MIN (c0 + 1, num_colors - 1);
+        const double t = pos - c0;
+        const double r = (stops[c0]->red + t * (stops[c1]->red - stops[c0]->red)) / d;
+        const double g = (stops[c0]->green + t * (stops[c1]->green - stops[c0]->green)) / d;
+        const double b = (stops[c0]->blue + t * (stops[c1]->blue - stops[c0]->blue)) / d;
+        sg->colors[i] = rgb_from_color (r, g, b);
+    }
+}
+
+void
+spectrogram_resize (struct spectrum_spectrogram_t *sg, int width, int history)
+{
+    width = MAX (width, 1);
+    history = MAX (history, 1);
+    if (sg->surface && sg->width == width && sg->history == history) {
+        return;
+    }
+    if (sg->surface) {
+        cairo_surface_destroy (sg->surface);
+        sg->surface = NULL;
+    }
+    sg->width = width;
+    sg->history = history;
+    sg->pos = 0;
+    sg->surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, history);
+
+    uint8_t *data = cairo_image_surface_get_data (sg->surface);
+    const int stride = cairo_image_surface_get_stride (sg->surface);
+    for (int y = 0; y < history; y++) {
+        uint32_t *row = (uint32_t *)(data + y * stride);
+        for (int x = 0; x < width; x++) {
+            row[x] = sg->background;
+        }
+    }
+    cairo_surface_mark_dirty (sg->surface);
+}
+
+void
+spectrogram_push (struct spectrum_spectrogram_t *sg, double *bars, double range)
+{
+    if (!sg->surface || range <= 0) {
+        return;
+    }
+
+    // Rows are written bottom up, so the history from the newest row to the
+    // end of the surface followed by its beginning is in display order
+    sg->pos = sg->pos > 0 ? sg->pos - 1 : sg->history - 1;
+
+    cairo_surface_flush (sg->surface);
+    uint8_t *data = cairo_image_surface_get_data (sg->surface);
+    const int stride = cairo_image_surface_get_stride (sg->surface);
+    uint32_t *row = (uint32_t *)(data + sg->pos * stride);
+
+    const double scale = (GRADIENT_TABLE_SIZE - 1) / range;
+    for (int x = 0; x < sg->width; x++) {
+        if (bars[x] <= 0) {
+            row[x] = sg->background;
+        }
+        else {
+            row[x] = sg->colors[MIN ((int)(bars[x] * scale), GRADIENT_TABLE_SIZE - 1)];
+        }
+    }
+    cairo_surface_mark_dirty_rectangle (sg->surface, 0, sg->pos, sg->width, 1);
+}
+
+static void
+spectrogram_blit (struct spectrum_spectrogram_t *sg, cairo_t *cr, int src_y, int dst_y, int height)
+{
+    if (height <= 0) {
+        return;
+    }
+    cairo_save (cr);
+    cairo_rectangle (cr, 0, dst_y, sg->width, height);
+    cairo_clip (cr);
+    cairo_set_source_surface (cr, sg->surface, 0, dst_y - src_y);
+    cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_FAST);
+    cairo_paint (cr);
+    cairo_restore (cr);
+}
+
+void
+spectrogram_draw (struct spectrum_spectrogram_t *sg, cairo_t *cr, cairo_rectangle_t *r)
+{
+    if (!sg->surface || r->width <= 0 || r->height <= 0) {
+        return;
+    }
+
+    cairo_save (cr);
+    cairo_translate (cr, r->x, r->y);
+    cairo_scale (cr, r->width / sg->width, r->height / sg->history);
+
+    // Two blits at the wrap point of the ring buffer
+    const int newest = sg->history - sg->pos;
+    spectrogram_blit (sg, cr, sg->pos, 0, newest);
+    spectrogram_blit (sg, cr, 0, newest, sg->pos);
+
+    cairo_restore (cr);
+}
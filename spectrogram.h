@@ -0,0 +1,59 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <gtk/gtk.h>
+
+#include "spectrum.h"
+
+// Ring buffer of spectrum rows, the newest row is drawn on top
+struct spectrum_spectrogram_t {
+    cairo_surface_t *surface;
+    // number of bands per row
+    int width;
+    // number of rows
+    int history;
+    // row which holds the newest data
+    int pos;
+    uint32_t background;
+    uint32_t colors[GRADIENT_TABLE_SIZE];
+};
+
+struct spectrum_spectrogram_t *
+spectrogram_new (void);
+
+void
+spectrogram_free (struct spectrum_spectrogram_t *sg);
+
+void
+spectrogram_colors_set (struct spectrum_spectrogram_t *sg, GList *colors, GdkColor *background);
+
+void
+spectrogram_resize (struct spectrum_spectrogram_t *sg, int width, int history);
+
+// Scrolls in a row of bars, one per frame of the redraw timer, so the time
+// axis follows the refresh rate
+void
+spectrogram_push (struct spectrum_spectrogram_t *sg, double *bars, double range);
+
+void
+spectrogram_draw (struct spectrum_spectrogram_t *sg, cairo_t *cr, cairo_rectangle_t *r);
@@ -15,82 +15,272 @@
 #include "config_dialog.h"
 #include "utils.h"
 #include "draw_utils.h"
+#include "worker.h"
+#include "analysis.h"
+#include "profile.h"
+#include "arena.h"
+#include "shm.h"
+#include "stream.h"
+#include "api.h"
+#include "recorder.h"
+#include "replay.h"
+#include "trace.h"
 #include "spectrum.h"
 
+// Used if the frame clock can't tell us the refresh rate of the monitor (60Hz)
+#define DEFAULT_FRAME_TIME 16667
+// Relative change of the interval suggested by the governor which makes us reschedule
+#define GOVERNOR_HYSTERESIS 0.1
+
 DB_functions_t *deadbeef = NULL;
 ddb_gtkui_t *gtkui_plugin = NULL;
 
-char *spectrum_notes[] =
-{
-    "C0","C#0","D0","D#0","E0","F0","F#0","G0","G#0","A0","A#0","B0",
-    "C1","C#1","D1","D#1","E1","F1","F#1","G1","G#1","A1","A#1","B1",
-    "C2","C#2","D2","D#2","E2","F2","F#2","G2","G#2","A2","A#2","B2",
-    "C3","C#3","D3","D#3","E3","F3","F#3","G3","G#3","A3","A#3","B3",
-    "C4","C#4","D4","D#4","E4","F4","F#4","G4","G#4","A4","A#4","B4",
-    "C5","C#5","D5","D#5","E5","F5","F#5","G5","G#5","A5","A#5","B5",
-    "C6","C#6","D6","D#6","E6","F6","F#6","G6","G#6","A6","A#6","B6",
-    "C7","C#7","D7","D#7","E7","F7","F#7","G7","G#7","A7","A#7","B7",
-    "C8","C#8","D8","D#8","E8","F8","F#8","G8","G#8","A8","A#8","B8",
-    "C9","C#9","D9","D#9","E9","F9","F#9","G9","G#9","A9","A#9","B9",
-    "C10","C#10","D10","D#10","E10","F10","F#10","G10","G#10","A10","A#10","B10",
-    "C11","C#11","D11","D#11","E11","F11","F#11","G11","G#11","A11","A#11","B11"
-};
+// Instances which currently exist, used to hand out config ids
+static GSList *instances = NULL;
 
-size_t spectrum_notes_size = sizeof (spectrum_notes)/sizeof (spectrum_notes[0]);
+static int
+spectrum_instance_id_used (int id)
+{
+    for (GSList *l = instances; l != NULL; l = l->next) {
+        w_spectrum_t *w = l->data;
+        if (w->config && w->config->instance == id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Idle callbacks queued by the message thread may run after the widget got
+// destroyed, both happen on the GTK thread
+static int
+spectrum_instance_alive (w_spectrum_t *w)
+{
+    return g_slist_find (instances, w) != NULL;
+}
 
+static int
+spectrum_instance_id_new (void)
+{
+    int id = 0;
+    while (spectrum_instance_id_used (id)) {
+        id++;
+    }
+    return id;
+}
+
+static void
+spectrum_request_frame (w_spectrum_t *w)
+{
+    GtkAllocation a;
+    gtk_widget_get_allocation (w->drawarea, &a);
+    spectrum_worker_request (w->worker, a.width, a.height, get_scale_factor (w->drawarea));
+}
+
+// Requests the next frame of the redraw timer
 static void
-spectrum_queue_spectrum_region (w_spectrum_t *s)
+spectrum_request_tick (w_spectrum_t *w)
 {
-    cairo_rectangle_t r = s->spectrum_rectangle;
-    gtk_widget_queue_draw_area (s->drawarea, r.x, r.y, r.width, r.height);
+    __atomic_add_fetch (&w->frame_ticks, 1, __ATOMIC_RELAXED);
+    spectrum_request_frame (w);
 }
 
+#if !GTK_CHECK_VERSION(3,8,0)
 static gboolean
 spectrum_draw_cb (void *data) {
     w_spectrum_t *s = data;
 
-    spectrum_queue_spectrum_region (s);
+    spectrum_request_tick (s);
     return TRUE;
 }
+#else
+static int
+spectrum_frame_divisor (w_spectrum_t *w, gint64 frame_time)
+{
+    const int divisor = config_get_int (ID_FRAME_DIVISOR);
+    if (divisor > 0) {
+        // The divisor sets the fastest rate, the adaptive refresh slows it
+        // down as much as it stretched the configured interval
+        const double slowdown = w->refresh_interval / (double)MAX (config_get_int (ID_REFRESH_INTERVAL), 1);
+        return MAX (divisor, (int)round (divisor * slowdown));
+    }
+    // Pick the frame rate closest to the requested refresh interval,
+    // prefer the faster one on a tie
+    const double frames = w->refresh_interval * 1000.0 / frame_time;
+    return MAX (1, (int)ceil (frames - 0.5));
+}
+
+static gboolean
+spectrum_tick_cb (GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data)
+{
+    w_spectrum_t *w = user_data;
+    config_use (w->config);
+
+    gint64 frame_time = 0;
+    gdk_frame_clock_get_refresh_info (frame_clock, gdk_frame_clock_get_frame_time (frame_clock), &frame_time, NULL);
+    if (frame_time <= 0) {
+        frame_time = DEFAULT_FRAME_TIME;
+    }
+
+    const int divisor = spectrum_frame_divisor (w, frame_time);
+    if (++w->frame_count < divisor) {
+        return G_SOURCE_CONTINUE;
+    }
+    w->frame_count = 0;
+
+    // Keep the physics in sync with the rate at which frames are presented
+    const double interval = divisor * frame_time / 1000.0;
+    if (interval != w->render->interval) {
+        spectrum_worker_lock (w->worker);
+        update_gravity (w->render, interval);
+        spectrum_worker_unlock (w->worker);
+    }
+
+    spectrum_request_tick (w);
+    return G_SOURCE_CONTINUE;
+}
+#endif
 
 static gboolean
 spectrum_redraw_cb (void *data) {
     w_spectrum_t *s = data;
-    s->need_redraw = 1;
-    gtk_widget_queue_draw (s->drawarea);
+    if (!spectrum_instance_alive (s)) {
+        return FALSE;
+    }
+    spectrum_request_frame (s);
     return FALSE;
 }
 
+// Switches to the analysis engine matching our config, called with the worker lock held
 static void
-on_config_changed (w_spectrum_t *w)
+spectrum_update_analysis (w_spectrum_t *w)
 {
-    load_config ();
-    deadbeef->mutex_lock (w->data->mutex);
-    w->need_redraw = 1;
-    if (w->data->fft_plan) {
-        fftw_destroy_plan (w->data->fft_plan);
+    struct spectrum_analysis_params_t params = spectrum_analysis_params_get ();
+    if (spectrum_analysis_matches (w->analysis, &params)) {
+        return;
     }
-    window_table_fill (w->data->window);
-    update_gravity (w->render);
+    struct spectrum_analysis_t *analysis = spectrum_analysis_acquire (&params);
+    if (w->listening) {
+        spectrum_analysis_listen (analysis);
+        spectrum_analysis_unlisten (w->analysis);
+    }
+    spectrum_analysis_release (w->analysis);
+    w->analysis = analysis;
+}
 
-    w->data->fft_plan = fftw_plan_dft_r2c_1d (CLAMP (config_get_int (ID_FFT_SIZE), 512, MAX_FFT_SIZE), w->data->fft_in, w->data->fft_out, FFTW_ESTIMATE);
-    deadbeef->mutex_unlock (w->data->mutex);
-    g_idle_add (spectrum_redraw_cb, w);
+// Returns 1 if the selected config plays a recording instead of the audio
+static int
+spectrum_replay_enabled (void)
+{
+    const char *replay = config_get_string (ID_STRING_REPLAY_FILE);
+    return replay && *replay;
+}
+
+static void
+spectrum_listen (w_spectrum_t *w, int listen)
+{
+    // Replays don't need the audio
+    config_use (w->config);
+    listen = listen && !spectrum_replay_enabled ();
+
+    spectrum_worker_lock (w->worker);
+    if (listen != w->listening) {
+        w->listening = listen;
+        if (listen) {
+            spectrum_analysis_listen (w->analysis);
+        }
+        else {
+            spectrum_analysis_unlisten (w->analysis);
+        }
+    }
+    spectrum_worker_unlock (w->worker);
+}
+
+static void
+spectrum_timer_stop (w_spectrum_t *w)
+{
+    if (w->drawtimer) {
+#if !GTK_CHECK_VERSION(3,8,0)
+        g_source_remove (w->drawtimer);
+#else
+        gtk_widget_remove_tick_callback (w->drawarea, w->drawtimer);
+#endif
+        w->drawtimer = 0;
+    }
+}
+
+static void
+spectrum_timer_start (w_spectrum_t *w)
+{
+    spectrum_timer_stop (w);
+#if !GTK_CHECK_VERSION(3,8,0)
+    update_gravity (w->render, w->refresh_interval);
+    w->drawtimer = g_timeout_add (w->refresh_interval, spectrum_draw_cb, w);
+#else
+    // Redraw in sync with the frame clock, the physics interval gets adjusted
+    // to the actual frame rate on the first tick
+    w->frame_count = 0;
+    w->drawtimer = gtk_widget_add_tick_callback (w->drawarea, spectrum_tick_cb, w, NULL);
+#endif
+}
+
+static void
+spectrum_remove_refresh_interval (w_spectrum_t *w)
+{
+    w->refresh_enabled = 0;
+    spectrum_timer_stop (w);
+}
+
+static void
+spectrum_window_state_disconnect (w_spectrum_t *w)
+{
+    if (w->toplevel) {
+        g_signal_handler_disconnect (w->toplevel, w->window_state_handler);
+        g_object_remove_weak_pointer (G_OBJECT (w->toplevel), (gpointer *)&w->toplevel);
+        w->toplevel = NULL;
+    }
+    w->window_state_handler = 0;
+    w->iconified = 0;
 }
 
 ///// spectrum vis
 static void
 w_spectrum_destroy (ddb_gtkui_widget_t *w) {
     w_spectrum_t *s = (w_spectrum_t *)w;
-    deadbeef->vis_waveform_unlisten (w);
-    if (s->drawtimer) {
-        g_source_remove (s->drawtimer);
-        s->drawtimer = 0;
+    spectrum_listen (s, 0);
+    spectrum_remove_refresh_interval (s);
+    spectrum_window_state_disconnect (s);
+    if (s->worker) {
+        spectrum_worker_free (s->worker);
+        s->worker = NULL;
+    }
+    if (s->shm) {
+        spectrum_shm_writer_free (s->shm);
+        s->shm = NULL;
+    }
+    if (s->stream) {
+        spectrum_stream_free (s->stream);
+        s->stream = NULL;
     }
-    if (CONFIG_GRADIENT_COLORS) {
-        g_list_foreach (CONFIG_GRADIENT_COLORS, (GFunc) g_free, NULL);
-        g_list_free (CONFIG_GRADIENT_COLORS);
-        CONFIG_GRADIENT_COLORS = NULL;
+    if (s->publisher) {
+        spectrum_api_publisher_free (s->publisher);
+        s->publisher = NULL;
+    }
+    if (s->recorder) {
+        spectrum_recorder_free (s->recorder);
+        s->recorder = NULL;
+    }
+    if (s->replay) {
+        spectrum_replay_free (s->replay);
+        s->replay = NULL;
+    }
+    if (s->analysis) {
+        spectrum_analysis_release (s->analysis);
+        s->analysis = NULL;
+    }
+    instances = g_slist_remove (instances, s);
+    if (s->config) {
+        config_store_free (s->config);
+        s->config = NULL;
     }
     if (s->data) {
         spectrum_data_free (s->data);
@@ -98,50 +288,175 @@ w_spectrum_destroy (ddb_gtkui_widget_t *w) {
     if (s->render) {
         spectrum_render_free (s->render);
     }
+    if (s->arena) {
+        spectrum_arena_free (s->arena);
+        s->arena = NULL;
+    }
+    if (s->overlay) {
+        spectrum_overlay_free (s->overlay);
+    }
+    if (s->hud) {
+        spectrum_profile_enable (0);
+        s->hud = 0;
+    }
+    if (s->profile) {
+        spectrum_profile_free (s->profile);
+        s->profile = NULL;
+    }
 }
 
 static void
-spectrum_remove_refresh_interval (w_spectrum_t *w)
+spectrum_set_refresh_interval (gpointer user_data, int interval)
 {
-    if (w->drawtimer) {
-        g_source_remove (w->drawtimer);
-        w->drawtimer = 0;
+    w_spectrum_t *w = user_data;
+    g_assert (interval > 0);
+
+    w->refresh_interval = interval;
+    w->refresh_enabled = 1;
+    governor_reset (&w->governor, interval);
+    if (w->visible) {
+        spectrum_timer_start (w);
     }
 }
 
+// Applies the refresh interval requested by the message thread
 static void
-spectrum_set_refresh_interval (gpointer user_data, int interval)
+spectrum_refresh_update (w_spectrum_t *w)
 {
-    w_spectrum_t *w = user_data;
-    g_assert (interval > 0);
+    config_use (w->config);
+    int interval = __atomic_load_n (&w->refresh_request, __ATOMIC_ACQUIRE);
+    // Replays advance with the redraws, whatever the playback is doing
+    if (interval <= 0 && spectrum_replay_enabled ()) {
+        interval = config_get_int (ID_REFRESH_INTERVAL);
+    }
+    if (interval > 0) {
+        spectrum_set_refresh_interval (w, interval);
+    }
+    else {
+        spectrum_remove_refresh_interval (w);
+    }
+}
 
-    spectrum_remove_refresh_interval (w);
-    w->drawtimer = g_timeout_add (interval, spectrum_draw_cb, w);
+static gboolean
+spectrum_refresh_update_cb (void *data)
+{
+    if (spectrum_instance_alive (data)) {
+        spectrum_refresh_update (data);
+    }
+    return FALSE;
 }
 
+// Timers belong to the GTK thread, messages only ask it to start or stop them
 static void
-spectrum_wavedata_listener (void *ctx, ddb_audio_data_t *data) {
-    w_spectrum_t *w = ctx;
-    g_assert (w->data->samples != NULL);
+spectrum_refresh_request (w_spectrum_t *w, int interval)
+{
+    __atomic_store_n (&w->refresh_request, interval, __ATOMIC_RELEASE);
+    g_idle_add (spectrum_refresh_update_cb, w);
+}
 
-    const int channels = data->fmt->channels;
-    const int nframes = data->nframes;
-    const int fft_size = config_get_int (ID_FFT_SIZE);
-    const int sz = channels * MIN (fft_size, nframes);
-    const int n = channels * fft_size - sz;
-    memmove (w->data->samples, w->data->samples + sz, n * sizeof (float));
-    memcpy (w->data->samples + n, data->data, sz * sizeof (float));
+// Rebuilds the parts affected by the changed settings, returns them
+static unsigned int
+on_config_changed (w_spectrum_t *w)
+{
+    const gint64 start = spectrum_trace_begin ();
+    // Wait for the render worker to finish its frame before touching the config
+    spectrum_worker_lock (w->worker);
+    load_config ();
+    const unsigned int changes = config_apply ();
+    if (changes & CONFIG_CHANGED_ANALYSIS) {
+        spectrum_update_analysis (w);
+    }
+    if (changes & CONFIG_CHANGED_TIMING) {
+        update_gravity (w->render, config_get_int (ID_REFRESH_INTERVAL));
+    }
+    // The rest gets rebuilt with the next frame
+    w->need_redraw |= changes & (CONFIG_CHANGED_BANDS | CONFIG_CHANGED_COLORS | CONFIG_CHANGED_STATIC);
+    spectrum_worker_unlock (w->worker);
+    if (changes & CONFIG_CHANGED_ANALYSIS) {
+        spectrum_listen (w, w->visible);
+    }
+    if (changes & (CONFIG_CHANGED_ANALYSIS | CONFIG_CHANGED_TIMING)) {
+        // Starting or stopping a replay decides whether redraws are needed
+        g_idle_add (spectrum_refresh_update_cb, w);
+    }
+    if (changes) {
+        g_idle_add (spectrum_redraw_cb, w);
+    }
+    spectrum_trace_end ("config_changed", start);
+    return changes;
+}
 
-    w->data->num_channels = channels;
-    w->data->channel_mask = data->fmt->channelmask;
+static void
+spectrum_update_visibility (w_spectrum_t *w)
+{
+    const int visible = gtk_widget_get_mapped (w->drawarea) && !w->iconified && !w->obscured;
+    if (visible == w->visible) {
+        return;
+    }
+    w->visible = visible;
+
+    if (visible) {
+        // The analysis engine is kept while hidden, so we can
+        // continue right where we stopped
+        spectrum_listen (w, 1);
+        if (w->refresh_enabled) {
+            spectrum_timer_start (w);
+        }
+        g_idle_add (spectrum_redraw_cb, w);
+    }
+    else {
+        spectrum_listen (w, 0);
+        spectrum_timer_stop (w);
+    }
+}
+
+static void
+spectrum_governor_frame (w_spectrum_t *w, double change, double cost)
+{
+    if (!config_get_int (ID_ADAPTIVE_REFRESH) || !w->drawtimer) {
+        return;
+    }
+
+    const double interval = governor_update (&w->governor, change, cost);
+    if (fabs (interval - w->refresh_interval) < w->refresh_interval * GOVERNOR_HYSTERESIS) {
+        return;
+    }
+    w->refresh_interval = (int)round (interval);
+#if !GTK_CHECK_VERSION(3,8,0)
+    spectrum_timer_start (w);
+#endif
+}
+
+static double
+spectrum_worker_draw_cb (void *ctx, cairo_t *cr, int width, int height)
+{
+    w_spectrum_t *w = ctx;
+    config_use (w->config);
+    spectrum_draw_frame (w, cr, width, height);
+    return w->render->change;
+}
+
+static void
+spectrum_worker_ready_cb (void *ctx)
+{
+    w_spectrum_t *w = ctx;
+    config_use (w->config);
+    // the render state belongs to the worker, it hands us the change of the frame
+    spectrum_governor_frame (w, spectrum_worker_change_get (w->worker), spectrum_worker_cost_get (w->worker));
+    gtk_widget_queue_draw (w->drawarea);
 }
 
 static gboolean
 spectrum_expose_event (GtkWidget *widget, GdkEventExpose *event, gpointer user_data)
 {
+    w_spectrum_t *w = user_data;
+    config_use (w->config);
+    spectrum_trace_thread_name ("gtk");
+    const gint64 start = spectrum_trace_begin ();
     cairo_t *cr = gdk_cairo_create (gtk_widget_get_window (widget));
     gboolean res = spectrum_draw (widget, cr, user_data);
     cairo_destroy (cr);
+    spectrum_trace_end ("expose", start);
     return res;
 }
 
@@ -153,6 +468,51 @@ spectrum_configure_event (GtkWidget *widget, GdkEvent *event, gpointer user_data
     return FALSE;
 }
 
+static gboolean
+spectrum_window_state_event (GtkWidget *widget, GdkEventWindowState *event, gpointer user_data)
+{
+    w_spectrum_t *w = user_data;
+    config_use (w->config);
+    w->iconified = (event->new_window_state & (GDK_WINDOW_STATE_ICONIFIED | GDK_WINDOW_STATE_WITHDRAWN)) ? 1 : 0;
+    spectrum_update_visibility (w);
+    return FALSE;
+}
+
+static void
+spectrum_map_event (GtkWidget *widget, gpointer user_data)
+{
+    w_spectrum_t *w = user_data;
+    config_use (w->config);
+
+    // The widget might have been moved to another window (e.g. in design mode)
+    GtkWidget *toplevel = gtk_widget_get_toplevel (widget);
+    if (toplevel != w->toplevel) {
+        spectrum_window_state_disconnect (w);
+        w->toplevel = toplevel;
+        g_object_add_weak_pointer (G_OBJECT (toplevel), (gpointer *)&w->toplevel);
+        w->window_state_handler = g_signal_connect_after ((gpointer) toplevel, "window_state_event", G_CALLBACK (spectrum_window_state_event), w);
+    }
+    spectrum_update_visibility (w);
+}
+
+static void
+spectrum_unmap_event (GtkWidget *widget, gpointer user_data)
+{
+    w_spectrum_t *w = user_data;
+    config_use (w->config);
+    spectrum_update_visibility (w);
+}
+
+static gboolean
+spectrum_visibility_notify_event (GtkWidget *widget, GdkEventVisibility *event, gpointer user_data)
+{
+    w_spectrum_t *w = user_data;
+    config_use (w->config);
+    w->obscured = event->state == GDK_VISIBILITY_FULLY_OBSCURED ? 1 : 0;
+    spectrum_update_visibility (w);
+    return FALSE;
+}
+
 static gboolean
 spectrum_button_release_event (GtkWidget *widget, GdkEventButton *event, gpointer user_data)
 {
@@ -175,10 +535,9 @@ static gboolean
 spectrum_leave_notify_event (GtkWidget *widget, GdkEventMotion *event, gpointer user_data)
 {
     w_spectrum_t *w = user_data;
+    config_use (w->config);
     w->motion_ctx.entered = 0;
-    if (config_get_int (ID_ENABLE_TOOLTIP)) {
-        spectrum_queue_spectrum_region (w);
-    }
+    spectrum_overlay_invalidate (w);
     return FALSE;
 }
 
@@ -186,11 +545,12 @@ static gboolean
 spectrum_motion_notify_event (GtkWidget *widget, GdkEventMotion *event, gpointer user_data)
 {
     w_spectrum_t *w = user_data;
+    config_use (w->config);
 
-    if (config_get_int (ID_ENABLE_TOOLTIP)) {
+    if (config_get_int (ID_ENABLE_TOOLTIP) || config_get_int (ID_ENABLE_OGRID)) {
         w->motion_ctx.x = event->x - 1;
         w->motion_ctx.y = event->y - 1;
-        spectrum_queue_spectrum_region (w);
+        spectrum_overlay_invalidate (w);
     }
 
     return FALSE;
@@ -200,14 +560,50 @@ static void
 spectrum_playback_stopped (w_spectrum_t *w)
 {
     w->playback_status = STOPPED;
-    spectrum_remove_refresh_interval (w);
+    spectrum_refresh_request (w, 0);
     g_idle_add (spectrum_redraw_cb, w);
 }
 
+static void
+spectrum_hud_toggled (GtkCheckMenuItem *item, gpointer user_data)
+{
+    w_spectrum_t *w = user_data;
+    const int hud = gtk_check_menu_item_get_active (item) ? 1 : 0;
+    if (hud == w->hud) {
+        return;
+    }
+    if (hud) {
+        spectrum_worker_lock (w->worker);
+        // Created on first use, most instances never show the overlay
+        if (!w->profile) {
+            w->profile = spectrum_profile_new ();
+        }
+        spectrum_profile_reset (w->profile);
+        spectrum_profile_reset (w->analysis->profile);
+        spectrum_worker_unlock (w->worker);
+        // the statistics of the last time are gone, the next frame brings new ones
+        spectrum_worker_stats_set (w->worker, "");
+    }
+    __atomic_store_n (&w->hud, hud, __ATOMIC_RELAXED);
+    spectrum_profile_enable (hud);
+    spectrum_request_frame (w);
+}
+
+static void
+spectrum_trace_save_activate (GtkMenuItem *item, gpointer user_data)
+{
+    if (spectrum_trace_dump () != 0) {
+        fprintf (stderr, "musical spectrum: failed to write the trace to %s\n", spectrum_trace_path ());
+    }
+}
+
 static int
 spectrum_message (ddb_gtkui_widget_t *widget, uint32_t id, uintptr_t ctx, uint32_t p1, uint32_t p2)
 {
     w_spectrum_t *w = (w_spectrum_t *)widget;
+    // Messages arrive on the thread of the message loop
+    spectrum_trace_thread_name ("messages");
+    config_use (w->config);
 
     const int samplerate_temp = w->samplerate;
     switch (id) {
@@ -215,32 +611,36 @@ spectrum_message (ddb_gtkui_widget_t *widget, uint32_t id, uintptr_t ctx, uint32
             w->samplerate = deadbeef->get_output ()->fmt.samplerate;
             if (w->samplerate == 0) w->samplerate = 44100;
             if (samplerate_temp != w->samplerate) {
-                w->need_redraw = 1;
+                spectrum_worker_lock (w->worker);
+                w->need_redraw |= CONFIG_CHANGED_BANDS | CONFIG_CHANGED_STATIC;
+                spectrum_worker_unlock (w->worker);
             }
             w->playback_status = PLAYING;
-            spectrum_set_refresh_interval (w, config_get_int (ID_REFRESH_INTERVAL));
+            spectrum_refresh_request (w, config_get_int (ID_REFRESH_INTERVAL));
             break;
         case DB_EV_SONGFINISHED:
             spectrum_playback_stopped (w);
             break;
         case DB_EV_CONFIGCHANGED:
-            on_config_changed (w);
+            if (!(on_config_changed (w) & CONFIG_CHANGED_TIMING)) {
+                break;
+            }
 #if (DDB_API_LEVEL >= 11)
             if (deadbeef->get_output ()->state () == DDB_PLAYBACK_STATE_PLAYING) {
 #else
             if (deadbeef->get_output ()->state () == OUTPUT_STATE_PLAYING) {
 #endif
-                spectrum_set_refresh_interval (w, config_get_int (ID_REFRESH_INTERVAL));
+                spectrum_refresh_request (w, config_get_int (ID_REFRESH_INTERVAL));
             }
             break;
         case DB_EV_PAUSED:
             if (p1 == 0) {
                 w->playback_status = PAUSED;
-                spectrum_set_refresh_interval (w, config_get_int (ID_REFRESH_INTERVAL));
+                spectrum_refresh_request (w, config_get_int (ID_REFRESH_INTERVAL));
             }
             else {
                 w->playback_status = PLAYING;
-                spectrum_remove_refresh_interval (w);
+                spectrum_refresh_request (w, 0);
                 g_idle_add (spectrum_redraw_cb, w);
             }
             break;
@@ -254,16 +654,22 @@ spectrum_message (ddb_gtkui_widget_t *widget, uint32_t id, uintptr_t ctx, uint32
 static void
 spectrum_init (w_spectrum_t *w) {
     w_spectrum_t *s = (w_spectrum_t *)w;
-    load_config ();
+    s->config = config_store_new (spectrum_instance_id_new ());
+    instances = g_slist_append (instances, s);
+    config_use (s->config);
 
+    struct spectrum_analysis_params_t params = spectrum_analysis_params_get ();
+    s->analysis = spectrum_analysis_acquire (&params);
     s->data = spectrum_data_new ();
     s->render = spectrum_render_new ();
+    s->arena = spectrum_arena_new ();
+    s->overlay = spectrum_overlay_new ();
+    s->worker = spectrum_worker_new (spectrum_worker_draw_cb, spectrum_worker_ready_cb, s);
 
     s->samplerate = deadbeef->get_output ()->fmt.samplerate;
     if (s->samplerate == 0) s->samplerate = 44100;
 
-    window_table_fill (s->data->window);
-    update_gravity (s->render);
+    update_gravity (s->render, config_get_int (ID_REFRESH_INTERVAL));
 
 #if (DDB_API_LEVEL >= 11)
     if (deadbeef->get_output ()->state () == DDB_PLAYBACK_STATE_PLAYING) {
@@ -271,14 +677,50 @@ spectrum_init (w_spectrum_t *w) {
     if (deadbeef->get_output ()->state () == OUTPUT_STATE_PLAYING) {
 #endif
         w->playback_status = PLAYING;
-        spectrum_set_refresh_interval (w, config_get_int (ID_REFRESH_INTERVAL));
+        w->refresh_request = config_get_int (ID_REFRESH_INTERVAL);
     }
-    deadbeef->vis_waveform_listen (w, spectrum_wavedata_listener);
-    s->need_redraw = 1;
+    // Listening to the waveform starts as soon as the widget gets mapped
+    config_apply ();
+    spectrum_refresh_update (w);
+    s->need_redraw = CONFIG_CHANGED_ALL;
     s->prev_width = -1;
     s->prev_height = -1;
 }
 
+static void
+spectrum_save (ddb_gtkui_widget_t *widget, char *s, int sz)
+{
+    w_spectrum_t *w = (w_spectrum_t *)widget;
+    char params[100] = {};
+    snprintf (params, sizeof (params), " instance=%d", w->config->instance);
+    strncat (s, params, sz - strlen (s) - 1);
+}
+
+// Switches to the config of the instance stored in the layout
+static const char *
+spectrum_load (ddb_gtkui_widget_t *widget, const char *type, const char *s)
+{
+    w_spectrum_t *w = (w_spectrum_t *)widget;
+    const char *params_end = strchr (s, '{');
+    if (!params_end) {
+        params_end = s + strlen (s);
+    }
+    const char *param = strstr (s, "instance=");
+    int instance = 0;
+    if (!param || param > params_end || sscanf (param, "instance=%d", &instance) != 1) {
+        return params_end;
+    }
+    if (instance < 0 || instance == w->config->instance || spectrum_instance_id_used (instance)) {
+        return params_end;
+    }
+    spectrum_worker_lock (w->worker);
+    w->config->instance = instance;
+    spectrum_worker_unlock (w->worker);
+    config_use (w->config);
+    on_config_changed (w);
+    return params_end;
+}
+
 static ddb_gtkui_widget_t *
 w_musical_spectrum_create (void) {
     w_spectrum_t *w = malloc (sizeof (w_spectrum_t));
@@ -287,19 +729,30 @@ w_musical_spectrum_create (void) {
     w->base.widget = gtk_event_box_new ();
     w->base.destroy  = w_spectrum_destroy;
     w->base.message = spectrum_message;
+    w->base.save = spectrum_save;
+    w->base.load = spectrum_load;
     w->drawarea = gtk_drawing_area_new ();
     w->popup = gtk_menu_new ();
     gtk_menu_attach_to_widget (GTK_MENU (w->popup), w->base.widget, NULL);
     w->popup_item = gtk_menu_item_new_with_mnemonic ("Configure");
+    w->hud_item = gtk_check_menu_item_new_with_mnemonic ("Performance overlay");
 
     gtk_container_add (GTK_CONTAINER (w->base.widget), w->drawarea);
     gtk_container_add (GTK_CONTAINER (w->popup), w->popup_item);
+    gtk_container_add (GTK_CONTAINER (w->popup), w->hud_item);
     gtk_widget_show (w->drawarea);
     gtk_widget_show (w->popup);
     gtk_widget_show (w->popup_item);
+    gtk_widget_show (w->hud_item);
+    if (spectrum_trace_path ()) {
+        GtkWidget *trace_item = gtk_menu_item_new_with_mnemonic ("Save trace");
+        gtk_container_add (GTK_CONTAINER (w->popup), trace_item);
+        gtk_widget_show (trace_item);
+        g_signal_connect_after ((gpointer) trace_item, "activate", G_CALLBACK (spectrum_trace_save_activate), w);
+    }
 
     gtk_widget_add_events (w->drawarea,
-            GDK_EXPOSURE_MASK | GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_POINTER_MOTION_MASK | GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK );
+            GDK_EXPOSURE_MASK | GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_POINTER_MOTION_MASK | GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK | GDK_VISIBILITY_NOTIFY_MASK );
 
 #if !GTK_CHECK_VERSION(3,0,0)
     g_signal_connect_after ((gpointer) w->drawarea, "expose_event", G_CALLBACK (spectrum_expose_event), w);
@@ -311,7 +764,11 @@ w_musical_spectrum_create (void) {
     g_signal_connect_after ((gpointer) w->drawarea, "motion_notify_event", G_CALLBACK (spectrum_motion_notify_event), w);
     g_signal_connect_after ((gpointer) w->drawarea, "enter_notify_event", G_CALLBACK (spectrum_enter_notify_event), w);
     g_signal_connect_after ((gpointer) w->drawarea, "leave_notify_event", G_CALLBACK (spectrum_leave_notify_event), w);
+    g_signal_connect_after ((gpointer) w->drawarea, "map", G_CALLBACK (spectrum_map_event), w);
+    g_signal_connect_after ((gpointer) w->drawarea, "unmap", G_CALLBACK (spectrum_unmap_event), w);
+    g_signal_connect_after ((gpointer) w->drawarea, "visibility_notify_event", G_CALLBACK (spectrum_visibility_notify_event), w);
     g_signal_connect_after ((gpointer) w->popup_item, "activate", G_CALLBACK (on_button_config), w);
+    g_signal_connect_after ((gpointer) w->hud_item, "toggled", G_CALLBACK (spectrum_hud_toggled), w);
     gtkui_plugin->w_override_signals (w->base.widget, w);
 
     spectrum_init (w);
@@ -326,7 +783,7 @@ musical_spectrum_connect (void)
         //trace("using '%s' plugin %d.%d\n", DDB_GTKUI_PLUGIN_ID, gtkui_plugin->gui.plugin.version_major, gtkui_plugin->gui.plugin.version_minor );
         if (gtkui_plugin->gui.plugin.version_major == 2) {
             // 0.6+, use the new widget API
-            gtkui_plugin->w_reg_widget ("Musical Spectrum", DDB_WF_SINGLE_INSTANCE, w_musical_spectrum_create, "musical_spectrum", NULL);
+            gtkui_plugin->w_reg_widget ("Musical Spectrum", 0, w_musical_spectrum_create, "musical_spectrum", NULL);
             return 0;
         }
     }
@@ -336,13 +793,19 @@ musical_spectrum_connect (void)
 static int
 musical_spectrum_start (void)
 {
-    load_config ();
+    config_init ();
+    spectrum_trace_init ();
+    spectrum_analysis_init ();
+    spectrum_api_init ();
     return 0;
 }
 
 static int
 musical_spectrum_stop (void)
 {
+    spectrum_api_cleanup ();
+    spectrum_analysis_cleanup ();
+    spectrum_trace_cleanup ();
     return 0;
 }
 
@@ -353,21 +816,21 @@ musical_spectrum_disconnect (void)
     return 0;
 }
 
-DB_misc_t plugin = {
+ddb_musical_spectrum_t plugin = {
     //DB_PLUGIN_SET_API_VERSION
-    .plugin.type            = DB_PLUGIN_MISC,
-    .plugin.api_vmajor      = 1,
-    .plugin.api_vminor      = 5,
-    .plugin.version_major   = 0,
-    .plugin.version_minor   = 9,
+    .misc.plugin.type            = DB_PLUGIN_MISC,
+    .misc.plugin.api_vmajor      = 1,
+    .misc.plugin.api_vminor      = 5,
+    .misc.plugin.version_major   = 0,
+    .misc.plugin.version_minor   = 9,
 #if GTK_CHECK_VERSION(3,0,0)
-    .plugin.id              = "musical_spectrum-gtk3",
+    .misc.plugin.id              = DDB_MUSICAL_SPECTRUM_ID_GTK3,
 #else
-    .plugin.id              = "musical_spectrum",
+    .misc.plugin.id              = DDB_MUSICAL_SPECTRUM_ID,
 #endif
-    .plugin.name            = "Musical Spectrum",
-    .plugin.descr           = "Musical Spectrum",
-    .plugin.copyright       =
+    .misc.plugin.name            = "Musical Spectrum",
+    .misc.plugin.descr           = "Musical Spectrum",
+    .misc.plugin.copyright       =
         "Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>\n"
         "\n"
         "Based on DeaDBeeFs stock spectrum.\n"
@@ -386,23 +849,29 @@ DB_misc_t plugin = {
         "along with this program; if not, write to the Free Software\n"
         "Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.\n"
      ,
-    .plugin.website         = "https://github.com/cboxdoerfer/ddb_musical_spectrum",
-    .plugin.start           = musical_spectrum_start,
-    .plugin.stop            = musical_spectrum_stop,
-    .plugin.connect         = musical_spectrum_connect,
-    .plugin.disconnect      = musical_spectrum_disconnect,
+    .misc.plugin.website         = "https://github.com/cboxdoerfer/ddb_musical_spectrum",
+    .misc.plugin.start           = musical_spectrum_start,
+    .misc.plugin.stop            = musical_spectrum_stop,
+    .misc.plugin.connect         = musical_spectrum_connect,
+    .misc.plugin.disconnect      = musical_spectrum_disconnect,
+    .api_version                 = DDB_MUSICAL_SPECTRUM_API_VERSION,
+    .frame_acquire               = spectrum_api_frame_acquire,
+    .frame_ref                   = spectrum_api_frame_ref,
+    .frame_release               = spectrum_api_frame_release,
+    .subscribe                   = spectrum_api_subscribe,
+    .unsubscribe                 = spectrum_api_unsubscribe,
 };
 
 #if !GTK_CHECK_VERSION(3,0,0)
 DB_plugin_t *
 ddb_vis_musical_spectrum_GTK2_load (DB_functions_t *ddb) {
     deadbeef = ddb;
-    return &plugin.plugin;
+    return &plugin.misc.plugin;
 }
 #else
 DB_plugin_t *
 ddb_vis_musical_spectrum_GTK3_load (DB_functions_t *ddb) {
     deadbeef = ddb;
-    return &plugin.plugin;
+    return &plugin.misc.plugin;
 }
 #endif
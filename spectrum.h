@@ -27,13 +27,16 @@
 #include <deadbeef/deadbeef.h>
 #include <deadbeef/gtkui_api.h>
 
-#define MAX_BARS 2000
+#include "governor.h"
+#include "spectrum_api.h"
+
+#define MAX_BARS 16384
 #define REFRESH_INTERVAL 25
 #define GRADIENT_TABLE_SIZE 1024
 #define MAX_FFT_SIZE 32768
 
 /* Global variables */
-extern DB_misc_t plugin;
+extern ddb_musical_spectrum_t plugin;
 extern DB_functions_t *deadbeef;
 extern ddb_gtkui_t *gtkui_plugin;
 
@@ -45,25 +48,19 @@ struct motion_context {
     double y;
 };
 
+// Mapping of the shared analysis result to the bands of one instance
 struct spectrum_data_t {
-    int num_channels;
-    int num_samples;
-    uint32_t channel_mask;
-    float *samples;
+    // copy of the magnitudes computed by the analysis engine
     double *spectrum;
-    double *window;
     double *frequency;
     int *keys;
     int *low_res_indices;
+    // amplitudes at the low resolution indices, input of the interpolation
+    // which reads one value past them
+    double *low_res_values;
 
     int low_res_end;
     int low_res_indices_num;
-
-    double *fft_in;
-    fftw_complex *fft_out;
-    fftw_plan fft_plan;
-
-    intptr_t mutex;
 };
 
 typedef struct {
@@ -71,18 +68,57 @@ typedef struct {
     GtkWidget *drawarea;
     GtkWidget *popup;
     GtkWidget *popup_item;
+    // timeout source (GTK2, GTK3 before 3.8) or tick callback driving the redraws
     guint drawtimer;
+    int frame_count;
+    // frames requested by the timer, other redraws don't advance the spectrogram
+    int frame_ticks;
+    // frame_ticks when the spectrogram got its last row, render worker only
+    int spectrogram_ticks;
+    int refresh_interval;
+    // redraws are wanted (playback is running), but only scheduled while visible
+    int refresh_enabled;
+    // interval the message thread asks for, 0 stops redraws; applied on the GTK thread
+    int refresh_request;
+    int visible;
+    int iconified;
+    int obscured;
+    GtkWidget *toplevel;
+    gulong window_state_handler;
+    struct spectrum_governor_t governor;
     int samplerate;
-    int need_redraw;
+    // parts to rebuild with the next frame, CONFIG_CHANGED_* flags
+    unsigned int need_redraw;
     int prev_width;
     int prev_height;
     enum PLAYBACK_STATUS playback_status;
 
-    cairo_rectangle_t spectrum_rectangle;
-
+    struct spectrum_config_store_t *config;
+    struct spectrum_analysis_t *analysis;
+    // whether the analysis engine counts us as listener
+    int listening;
     struct spectrum_data_t *data;
     struct spectrum_render_t *render;
+    // backing memory of the arrays in data and render and what they are sized for
+    struct spectrum_arena_t *arena;
+    int buffer_bins;
+    int buffer_bands;
+    struct spectrum_worker_t *worker;
+    struct spectrum_overlay_t *overlay;
+    // bands published to other processes, only used by the render worker
+    struct spectrum_shm_writer_t *shm;
+    struct spectrum_stream_t *stream;
+    // frames for other plugins, created once one of them uses the API
+    struct spectrum_api_publisher_t *publisher;
+    // records the frames to the record_file, only used by the render worker
+    struct spectrum_recorder_t *recorder;
+    // plays the replay_file instead of analysing the audio, render worker only
+    struct spectrum_replay_t *replay;
     struct motion_context motion_ctx;
+    // stage timings, only collected while a performance overlay is shown
+    struct spectrum_profile_t *profile;
+    GtkWidget *hud_item;
+    int hud;
 } w_spectrum_t;
 
 extern char *spectrum_notes[];
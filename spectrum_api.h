@@ -0,0 +1,98 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// API other DeaDBeeF plugins use to get the analysis of the musical spectrum
+// widget instead of running their own FFT:
+//
+//   ddb_musical_spectrum_t *spectrum =
+//       (ddb_musical_spectrum_t *)deadbeef->plug_get_for_id (DDB_MUSICAL_SPECTRUM_ID);
+//
+// (DDB_MUSICAL_SPECTRUM_ID_GTK3 for the GTK3 build). Check api_version
+// before using the functions, in the connect callback or later.
+//
+// Every frame the widget draws is published as an immutable frame, shared by
+// all consumers without copying. A consumer either asks for the latest frame
+// of an instance when it needs one, or subscribes to get every frame. Frames
+// stay valid until the consumer releases its reference, even if the widget is
+// destroyed in the meantime.
+//
+// Publishing starts with the first call of frame_acquire or subscribe, and
+// only while a widget is visible and drawing.
+
+#include <stdint.h>
+#include <deadbeef/deadbeef.h>
+
+#define DDB_MUSICAL_SPECTRUM_ID "musical_spectrum"
+#define DDB_MUSICAL_SPECTRUM_ID_GTK3 "musical_spectrum-gtk3"
+#define DDB_MUSICAL_SPECTRUM_API_VERSION 1
+
+typedef struct {
+    // widget instance, the first one is 0
+    int instance;
+    // counts the frames of the instance, starting at 1
+    uint64_t frame;
+    // CLOCK_MONOTONIC in microseconds when the frame was finished
+    int64_t timestamp;
+    int samplerate;
+    int fft_size;
+
+    // Magnitude spectrum in dB of the analysed block, fft_size / 2 + 1 bins,
+    // bin i is at i * samplerate / fft_size Hz. Silent bins are -DBL_MAX.
+    int num_bins;
+    const double *spectrum;
+
+    // Levels and peaks of the displayed bands in dB, as drawn (including
+    // gravity and smoothing), and the center frequencies of the bands in Hz
+    int num_bands;
+    const double *bands;
+    const double *peaks;
+    const double *frequency;
+    // displayed range, levels at or below amp_min are silent
+    double amp_min;
+    double amp_max;
+} ddb_spectrum_frame_t;
+
+// Called on the render thread of the widget after each frame, it must return
+// quickly. The frame is only valid during the call unless the callback takes
+// a reference with frame_ref.
+typedef void (*ddb_spectrum_callback_t) (const ddb_spectrum_frame_t *frame, void *user_data);
+
+typedef struct {
+    DB_misc_t misc;
+    int api_version;
+
+    // Latest frame of the instance with a reference for the caller, NULL if
+    // it doesn't exist or hasn't drawn a frame since publishing started
+    const ddb_spectrum_frame_t *(*frame_acquire) (int instance);
+    // Takes another reference
+    void (*frame_ref) (const ddb_spectrum_frame_t *frame);
+    // Drops a reference, the frame must not be used afterwards
+    void (*frame_release) (const ddb_spectrum_frame_t *frame);
+
+    // Calls callback with every frame of the instance, or of all instances
+    // if instance is -1. Returns an id > 0, or -1 if there are too many
+    // subscriptions.
+    int (*subscribe) (int instance, ddb_spectrum_callback_t callback, void *user_data);
+    // Once this returns, the callback isn't running and won't be called again.
+    // It may be called from within the callback.
+    void (*unsubscribe) (int id);
+} ddb_musical_spectrum_t;
@@ -0,0 +1,82 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Layout of the files the recorder writes, included by tools reading them as
+// well, so it only depends on the C library.
+//
+// A file starts with the header, followed by the center frequencies of the
+// bands. The records start at data_offset, each record_size bytes, so record
+// i is at data_offset + i * record_size. A record holds the time of the frame
+// and the levels and peaks of all bands in dB, see spectrum_record_t. Levels
+// are the bands before gravity is applied, peaks are as drawn.
+//
+// All values are in host byte order. num_records counts the complete records,
+// a file which is still being written (or was left behind by a crash) may be
+// larger than that.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SPECTRUM_RECORD_MAGIC 0x5253534d
+#define SPECTRUM_RECORD_VERSION 1
+
+struct spectrum_record_header_t {
+    uint32_t magic;
+    uint32_t version;
+    // offset of the first record
+    uint32_t data_offset;
+    // bytes of each record
+    uint32_t record_size;
+    uint32_t num_bands;
+    uint32_t samplerate;
+    uint32_t fft_size;
+    // interval between frames in microseconds when recording started, the
+    // actual time of each frame is in its record
+    uint32_t hop;
+    // displayed range
+    float amp_min;
+    float amp_max;
+    uint64_t num_records;
+    // CLOCK_REALTIME in microseconds when recording started
+    int64_t start_time;
+};
+
+struct spectrum_record_t {
+    // microseconds since the first record
+    int64_t time;
+    // num_bands levels followed by num_bands peaks, silent bands are -FLT_MAX
+    float values[];
+};
+
+// Center frequencies of the bands in Hz, num_bands values
+static inline const float *
+spectrum_record_frequency (const struct spectrum_record_header_t *header)
+{
+    return (const float *)(header + 1);
+}
+
+static inline const struct spectrum_record_t *
+spectrum_record_get (const struct spectrum_record_header_t *header, uint64_t index)
+{
+    return (const struct spectrum_record_t *)((const char *)header + header->data_offset
+                                              + index * header->record_size);
+}
@@ -0,0 +1,100 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Layout of the shared memory segment the bands of every frame are
+// published to, included by readers in other processes as well, so it
+// only depends on the C library.
+//
+// The segment is named SPECTRUM_SHM_NAME with the uid of the player and the
+// instance of the widget filled in, e.g. /musical_spectrum.1000.0, and exists
+// while the widget publishes (config key musical_spectrum.shared_memory).
+//
+// It is updated with a sequence lock: the writer increments seq before and
+// after writing a frame, so seq is odd while a frame is being written. A
+// reader copies what it needs and keeps the copy if seq was even and
+// unchanged before and after, see spectrum_shm_read.
+
+#include <stdint.h>
+#include <string.h>
+
+#define SPECTRUM_SHM_NAME "/musical_spectrum.%u.%d"
+#define SPECTRUM_SHM_MAGIC 0x4853534d
+#define SPECTRUM_SHM_VERSION 1
+// bands the arrays have room for, equal to the maximum number of bars
+#define SPECTRUM_SHM_CAPACITY 16384
+
+struct spectrum_shm_frame_t {
+    // counts the published frames, starting at 1
+    uint64_t frame;
+    // CLOCK_MONOTONIC in microseconds when the frame was finished
+    int64_t timestamp;
+    uint32_t num_bands;
+    uint32_t samplerate;
+    // lower end of the displayed range in dB, bands at or below it are silent
+    float amp_min;
+    float amp_max;
+};
+
+struct spectrum_shm_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    // odd while a frame is being written
+    uint32_t seq;
+    struct spectrum_shm_frame_t info;
+    // levels and peaks of the bands in dB, center frequencies in Hz
+    float bands[SPECTRUM_SHM_CAPACITY];
+    float peaks[SPECTRUM_SHM_CAPACITY];
+    float frequency[SPECTRUM_SHM_CAPACITY];
+};
+
+// Copies the latest frame, up to max_bands bands of each array which may be
+// NULL. Returns 0 on success and -1 if the writer was busy, try again then.
+static inline int
+spectrum_shm_read (const struct spectrum_shm_t *shm, struct spectrum_shm_frame_t *info,
+                   float *bands, float *peaks, float *frequency, uint32_t max_bands)
+{
+    const uint32_t seq = __atomic_load_n (&shm->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) {
+        return -1;
+    }
+    *info = shm->info;
+    uint32_t n = info->num_bands < max_bands ? info->num_bands : max_bands;
+    if (n > SPECTRUM_SHM_CAPACITY) {
+        n = SPECTRUM_SHM_CAPACITY;
+    }
+    if (bands) {
+        memcpy (bands, shm->bands, n * sizeof (float));
+    }
+    if (peaks) {
+        memcpy (peaks, shm->peaks, n * sizeof (float));
+    }
+    if (frequency) {
+        memcpy (frequency, shm->frequency, n * sizeof (float));
+    }
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    if (__atomic_load_n (&shm->seq, __ATOMIC_RELAXED) != seq) {
+        return -1;
+    }
+    info->num_bands = n;
+    return 0;
+}
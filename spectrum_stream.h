@@ -0,0 +1,81 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Protocol of the Unix domain socket the bands of every frame are streamed
+// to, included by clients in other processes as well, so it only depends on
+// the C library.
+//
+// The socket exists while the widget streams (config key
+// musical_spectrum.socket_stream set to 8 or 16, the bits per band). It is
+// created in $XDG_RUNTIME_DIR, or in /tmp with the uid in its name, see
+// spectrum_stream_path. Clients connect and then only read: every frame is a
+// header followed by num_bands unsigned values of header.bits bits each, in
+// host byte order. A client which reads too slowly misses frames, but never
+// gets a partial one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define SPECTRUM_STREAM_MAGIC 0x4653534d
+#define SPECTRUM_STREAM_VERSION 1
+
+struct spectrum_stream_header_t {
+    uint32_t magic;
+    uint16_t version;
+    // bits per band, 8 or 16
+    uint8_t bits;
+    uint8_t reserved;
+    // bytes of the whole frame, including this header
+    uint32_t size;
+    uint32_t num_bands;
+    uint32_t samplerate;
+    // frames this client missed because it didn't read fast enough
+    uint32_t dropped;
+    // counts the streamed frames, starting at 1
+    uint64_t frame;
+    // CLOCK_MONOTONIC in microseconds when the frame was finished
+    int64_t timestamp;
+    // displayed range, the largest value maps to amp_max
+    float amp_min;
+    float amp_max;
+};
+
+// Level in dB of a band value, values of 0 are at or below amp_min
+static inline double
+spectrum_stream_db (const struct spectrum_stream_header_t *header, uint32_t value)
+{
+    const double max_value = (1u << header->bits) - 1;
+    return header->amp_min + value / max_value * (header->amp_max - header->amp_min);
+}
+
+// Path of the socket of an instance, returns the length like snprintf
+static inline int
+spectrum_stream_path (char *dest, size_t size, int instance)
+{
+    const char *dir = getenv ("XDG_RUNTIME_DIR");
+    if (dir && *dir) {
+        return snprintf (dest, size, "%s/musical_spectrum.%d.sock", dir, instance);
+    }
+    return snprintf (dest, size, "/tmp/musical_spectrum.%u.%d.sock", (unsigned int)getuid (), instance);
+}
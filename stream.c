@@ -0,0 +1,237 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <gtk/gtk.h>
+
+#include "spectrum.h"
+#include "stream.h"
+
+static void
+spectrum_stream_client_close (struct spectrum_stream_client_t *client)
+{
+    if (client->fd >= 0) {
+        close (client->fd);
+        client->fd = -1;
+    }
+    if (client->slots) {
+        free (client->slots);
+        client->slots = NULL;
+    }
+    client->queued = 0;
+    client->offset = 0;
+    client->dropped = 0;
+}
+
+struct spectrum_stream_t *
+spectrum_stream_new (int instance)
+{
+    struct spectrum_stream_t *stream = calloc (1, sizeof (struct spectrum_stream_t));
+    stream->instance = instance;
+    stream->fd = -1;
+    // Room for the largest frame, 16 bits per band
+    stream->slot_size = sizeof (struct spectrum_stream_header_t) + MAX_BARS * sizeof (uint16_t);
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        stream->clients[i].fd = -1;
+    }
+
+    spectrum_stream_path (stream->path, sizeof (stream->path), instance);
+    const int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf (stderr, "musical spectrum: failed to create socket: %s\n", strerror (errno));
+        return stream;
+    }
+    struct sockaddr_un addr = {
+        .sun_family = AF_UNIX,
+    };
+    strncpy (addr.sun_path, stream->path, sizeof (addr.sun_path) - 1);
+    // A socket left behind by a crashed player is replaced
+    unlink (stream->path);
+    if (bind (fd, (struct sockaddr *)&addr, sizeof (addr)) != 0
+        || chmod (stream->path, 0600) != 0
+        || listen (fd, STREAM_MAX_CLIENTS) != 0) {
+        fprintf (stderr, "musical spectrum: failed to listen on %s: %s\n", stream->path, strerror (errno));
+        close (fd);
+        unlink (stream->path);
+        return stream;
+    }
+    stream->fd = fd;
+    return stream;
+}
+
+void
+spectrum_stream_free (struct spectrum_stream_t *stream)
+{
+    if (!stream) {
+        return;
+    }
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        spectrum_stream_client_close (&stream->clients[i]);
+    }
+    if (stream->fd >= 0) {
+        close (stream->fd);
+        stream->fd = -1;
+        unlink (stream->path);
+    }
+    free (stream);
+    stream = NULL;
+}
+
+static void
+spectrum_stream_accept (struct spectrum_stream_t *stream)
+{
+    while (1) {
+        const int fd = accept4 (stream->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct spectrum_stream_client_t *client = NULL;
+        for (int i = 0; i < STREAM_MAX_CLIENTS && !client; i++) {
+            if (stream->clients[i].fd < 0) {
+                client = &stream->clients[i];
+            }
+        }
+        if (client) {
+            client->slots = malloc (STREAM_QUEUE * stream->slot_size);
+        }
+        if (!client || !client->slots) {
+            close (fd);
+            continue;
+        }
+        client->fd = fd;
+        for (int i = 0; i < STREAM_QUEUE; i++) {
+            client->queue[i] = i;
+        }
+    }
+}
+
+// Queues a copy of the frame, returns the slot it has to be written to
+static uint8_t *
+spectrum_stream_client_push (struct spectrum_stream_client_t *client, size_t slot_size)
+{
+    if (client->queued == STREAM_QUEUE) {
+        // Drop the oldest frame, unless it's partially sent already
+        const int drop = client->offset > 0 ? 1 : 0;
+        const int slot = client->queue[drop];
+        memmove (&client->queue[drop], &client->queue[drop + 1], (STREAM_QUEUE - drop - 1) * sizeof (int));
+        client->queue[STREAM_QUEUE - 1] = slot;
+        client->queued--;
+        client->dropped++;
+    }
+    // Unused slots follow the queued ones
+    return client->slots + client->queue[client->queued++] * slot_size;
+}
+
+// Sends as much as the socket takes, returns -1 if the client is gone
+static int
+spectrum_stream_client_flush (struct spectrum_stream_client_t *client, size_t slot_size)
+{
+    while (client->queued > 0) {
+        const uint8_t *frame = client->slots + client->queue[0] * slot_size;
+        const size_t size = ((const struct spectrum_stream_header_t *)frame)->size;
+        const ssize_t n = send (client->fd, frame + client->offset, size - client->offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        client->offset += n;
+        if (client->offset < size) {
+            return 0;
+        }
+        const int slot = client->queue[0];
+        memmove (&client->queue[0], &client->queue[1], (STREAM_QUEUE - 1) * sizeof (int));
+        client->queue[STREAM_QUEUE - 1] = slot;
+        client->queued--;
+        client->offset = 0;
+    }
+    return 0;
+}
+
+void
+spectrum_stream_publish (struct spectrum_stream_t *stream, int bits, const double *bars, int num_bands,
+                         int samplerate, int amp_min, int amp_max)
+{
+    if (stream->fd < 0) {
+        return;
+    }
+    spectrum_stream_accept (stream);
+
+    bits = bits > 8 ? 16 : 8;
+    num_bands = CLAMP (num_bands, 0, MAX_BARS);
+    const size_t size = sizeof (struct spectrum_stream_header_t) + num_bands * (bits / 8);
+    const struct spectrum_stream_header_t header = {
+        .magic = SPECTRUM_STREAM_MAGIC,
+        .version = SPECTRUM_STREAM_VERSION,
+        .bits = bits,
+        .size = size,
+        .num_bands = num_bands,
+        .samplerate = samplerate,
+        .frame = ++stream->frame,
+        .timestamp = g_get_monotonic_time (),
+        .amp_min = amp_min,
+        .amp_max = amp_max,
+    };
+    const double range = MAX (amp_max - amp_min, 1);
+    const double max_value = (1u << bits) - 1;
+
+    // Encoded once into the first client's slot and copied to the others
+    uint8_t *encoded = NULL;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        struct spectrum_stream_client_t *client = &stream->clients[i];
+        if (client->fd < 0) {
+            continue;
+        }
+        uint8_t *frame = spectrum_stream_client_push (client, stream->slot_size);
+        if (!encoded) {
+            memcpy (frame, &header, sizeof (header));
+            uint8_t *values = frame + sizeof (header);
+            for (int b = 0; b < num_bands; b++) {
+                const double v = CLAMP (bars[b] / range, 0, 1) * max_value + 0.5;
+                if (bits == 16) {
+                    ((uint16_t *)values)[b] = (uint16_t)v;
+                }
+                else {
+                    values[b] = (uint8_t)v;
+                }
+            }
+            encoded = frame;
+        }
+        else {
+            memcpy (frame, encoded, size);
+        }
+        ((struct spectrum_stream_header_t *)frame)->dropped = client->dropped;
+        if (spectrum_stream_client_flush (client, stream->slot_size) != 0) {
+            spectrum_stream_client_close (client);
+            // the encoded frame might have been in this client's slots
+            if (frame == encoded) {
+                encoded = NULL;
+            }
+        }
+    }
+}
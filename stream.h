@@ -0,0 +1,70 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "spectrum_stream.h"
+
+// Clients served at the same time, further ones get disconnected
+#define STREAM_MAX_CLIENTS 8
+// Frames queued for a client, the oldest one which hasn't been started gets
+// dropped when another arrives
+#define STREAM_QUEUE 4
+
+struct spectrum_stream_client_t {
+    int fd;
+    // STREAM_QUEUE frames of slot_size bytes
+    uint8_t *slots;
+    // slots of the queued frames, oldest first
+    int queue[STREAM_QUEUE];
+    int queued;
+    // bytes of the oldest frame which are already sent
+    size_t offset;
+    uint32_t dropped;
+};
+
+// Streams the bands of every frame to the clients of a Unix domain socket.
+// Nothing blocks, clients which don't keep up lose frames.
+struct spectrum_stream_t {
+    int instance;
+    // listening socket, -1 if it couldn't be created
+    int fd;
+    char path[108];
+    size_t slot_size;
+    uint64_t frame;
+    struct spectrum_stream_client_t clients[STREAM_MAX_CLIENTS];
+};
+
+// Creates the socket of the instance, replacing a stale one
+struct spectrum_stream_t *
+spectrum_stream_new (int instance);
+
+// Disconnects the clients and removes the socket
+void
+spectrum_stream_free (struct spectrum_stream_t *stream);
+
+// Accepts new clients and queues the frame for all of them. Levels are
+// relative to amp_min, as the render state keeps them.
+void
+spectrum_stream_publish (struct spectrum_stream_t *stream, int bits, const double *bars, int num_bands,
+                         int samplerate, int amp_min, int amp_max);
@@ -0,0 +1,197 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "spectrum.h"
+#include "trace.h"
+
+// Threads which can be named in the trace
+#define TRACE_THREADS 32
+
+struct trace_event_t {
+    // index of the event + 1, 0 while it is being written
+    uint64_t seq;
+    const char *name;
+    gint64 start;
+    gint64 end;
+    int tid;
+};
+
+struct trace_thread_t {
+    int tid;
+    const char *name;
+};
+
+int trace_enabled = 0;
+
+static char *trace_path = NULL;
+static struct trace_event_t *events = NULL;
+static uint64_t events_head = 0;
+static struct trace_thread_t threads[TRACE_THREADS];
+static int num_threads = 0;
+static intptr_t trace_mutex = 0;
+
+static __thread int thread_id = 0;
+static __thread int thread_named = 0;
+
+static int
+trace_tid (void)
+{
+    if (!thread_id) {
+#ifdef __linux__
+        thread_id = (int)syscall (SYS_gettid);
+#else
+        static int next_id = 0;
+        thread_id = __atomic_add_fetch (&next_id, 1, __ATOMIC_RELAXED);
+#endif
+    }
+    return thread_id;
+}
+
+void
+spectrum_trace_init (void)
+{
+    const char *path = getenv ("MUSICAL_SPECTRUM_TRACE");
+    if (!path || !*path) {
+        return;
+    }
+    events = calloc (TRACE_EVENTS, sizeof (struct trace_event_t));
+    if (!events) {
+        return;
+    }
+    trace_path = strdup (path);
+    trace_mutex = deadbeef->mutex_create ();
+    __atomic_store_n (&trace_enabled, 1, __ATOMIC_RELEASE);
+}
+
+void
+spectrum_trace_cleanup (void)
+{
+    if (!trace_enabled) {
+        return;
+    }
+    spectrum_trace_dump ();
+    // The ring stays allocated, a thread which is still running might be
+    // writing an event right now
+    __atomic_store_n (&trace_enabled, 0, __ATOMIC_RELEASE);
+    if (trace_mutex) {
+        deadbeef->mutex_free (trace_mutex);
+        trace_mutex = 0;
+    }
+}
+
+const char *
+spectrum_trace_path (void)
+{
+    return trace_enabled ? trace_path : NULL;
+}
+
+void
+spectrum_trace_event (const char *name, gint64 start, gint64 end)
+{
+    if (!start || !trace_enabled) {
+        return;
+    }
+    const uint64_t index = __atomic_fetch_add (&events_head, 1, __ATOMIC_RELAXED);
+    struct trace_event_t *e = &events[index % TRACE_EVENTS];
+    // Zero while writing, the fence keeps the event stores after it
+    __atomic_store_n (&e->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    e->name = name;
+    e->start = start;
+    e->end = end;
+    e->tid = trace_tid ();
+    __atomic_store_n (&e->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+void
+spectrum_trace_end (const char *name, gint64 start)
+{
+    if (!start) {
+        return;
+    }
+    spectrum_trace_event (name, start, g_get_monotonic_time ());
+}
+
+void
+spectrum_trace_thread_name (const char *name)
+{
+    if (!trace_enabled || thread_named) {
+        return;
+    }
+    thread_named = 1;
+    deadbeef->mutex_lock (trace_mutex);
+    if (num_threads < TRACE_THREADS) {
+        threads[num_threads].tid = trace_tid ();
+        threads[num_threads].name = name;
+        num_threads++;
+    }
+    deadbeef->mutex_unlock (trace_mutex);
+}
+
+int
+spectrum_trace_dump (void)
+{
+    if (!trace_enabled) {
+        return -1;
+    }
+    deadbeef->mutex_lock (trace_mutex);
+    FILE *f = fopen (trace_path, "w");
+    if (!f) {
+        deadbeef->mutex_unlock (trace_mutex);
+        return -1;
+    }
+    const int pid = getpid ();
+    fprintf (f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf (f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"musical spectrum\"}}", pid);
+    for (int i = 0; i < num_threads; i++) {
+        fprintf (f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                 pid, threads[i].tid, threads[i].name);
+    }
+
+    const uint64_t head = __atomic_load_n (&events_head, __ATOMIC_ACQUIRE);
+    const uint64_t first = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+    for (uint64_t i = first; i < head; i++) {
+        const struct trace_event_t *e = &events[i % TRACE_EVENTS];
+        if (__atomic_load_n (&e->seq, __ATOMIC_ACQUIRE) != i + 1) {
+            continue;
+        }
+        const struct trace_event_t copy = *e;
+        // skip events which got overwritten while we copied them, the fence
+        // keeps the copy before the check
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+        if (__atomic_load_n (&e->seq, __ATOMIC_ACQUIRE) != i + 1) {
+            continue;
+        }
+        fprintf (f, ",\n{\"name\": \"%s\", \"cat\": \"spectrum\", \"ph\": \"X\", \"ts\": %lld, \"dur\": %lld, \"pid\": %d, \"tid\": %d}",
+                 copy.name, (long long)copy.start, (long long)(copy.end - copy.start), pid, copy.tid);
+    }
+    fprintf (f, "\n]}\n");
+    fclose (f);
+    deadbeef->mutex_unlock (trace_mutex);
+    return 0;
+}
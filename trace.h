@@ -0,0 +1,67 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#pragma once
+
+#include <glib.h>
+
+// Opt-in tracer of the frame pipeline. When the environment variable
+// MUSICAL_SPECTRUM_TRACE names a file, timed sections of all threads are
+// recorded into a fixed size ring and written to that file as Chrome trace
+// JSON on request and when the plugin stops. Timestamps are taken from the
+// monotonic clock, so they line up with system traces.
+
+// Number of events kept, older ones get overwritten
+#define TRACE_EVENTS 65536
+
+extern int trace_enabled;
+
+void
+spectrum_trace_init (void);
+
+// Writes the remaining events and stops tracing
+void
+spectrum_trace_cleanup (void);
+
+// Path of the trace file, NULL if tracing is off
+const char *
+spectrum_trace_path (void);
+
+// Start of a traced section, 0 if tracing is off
+static inline gint64
+spectrum_trace_begin (void)
+{
+    return trace_enabled ? g_get_monotonic_time () : 0;
+}
+
+// Records a section from start until now, name has to be a static string
+void
+spectrum_trace_end (const char *name, gint64 start);
+
+// Like spectrum_trace_end with an explicit end time
+void
+spectrum_trace_event (const char *name, gint64 start, gint64 end);
+
+// Names the calling thread in the trace, only the first call per thread counts
+void
+spectrum_trace_thread_name (const char *name);
+
+// Writes the events in the ring to the trace file, returns 0 on success
+int
+spectrum_trace_dump (void);
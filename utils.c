@@ -32,83 +32,103 @@
 #include "spectrum.h"
 #include "utils.h"
 
+char *spectrum_notes[] =
+{
+    "C0","C#0","D0","D#0","E0","F0","F#0","G0","G#0","A0","A#0","B0",
+    "C1","C#1","D1","D#1","E1","F1","F#1","G1","G#1","A1","A#1","B1",
+    "C2","C#2","D2","D#2","E2","F2","F#2","G2","G#2","A2","A#2","B2",
+    "C3","C#3","D3","D#3","E3","F3","F#3","G3","G#3","A3","A#3","B3",
+    "C4","C#4","D4","D#4","E4","F4","F#4","G4","G#4","A4","A#4","B4",
+    "C5","C#5","D5","D#5","E5","F5","F#5","G5","G#5","A5","A#5","B5",
+    "C6","C#6","D6","D#6","E6","F6","F#6","G6","G#6","A6","A#6","B6",
+    "C7","C#7","D7","D#7","E7","F7","F#7","G7","G#7","A7","A#7","B7",
+    "C8","C#8","D8","D#8","E8","F8","F#8","G8","G#8","A8","A#8","B8",
+    "C9","C#9","D9","D#9","E9","F9","F#9","G9","G#9","A9","A#9","B9",
+    "C10","C#10","D10","D#10","E10","F10","F#10","G10","G#10","A10","A#10","B10",
+    "C11","C#11","D11","D#11","E11","F11","F#11","G11","G#11","A11","A#11","B11"
+};
+
+size_t spectrum_notes_size = sizeof (spectrum_notes)/sizeof (spectrum_notes[0]);
+
 static int
 num_bars_for_width (int width)
 {
     return CLAMP (width, 1, MAX_BARS);
 }
 
+// Number of bands which still carry information: as many bands per octave as
+// there are FFT bins in the highest displayed octave. Lower octaves have fewer
+// bins, their bands get interpolated anyway.
+static int
+num_bars_for_fft (int samplerate)
+{
+    const int num_notes = get_num_notes ();
+    const double nyquist = samplerate / 2.0;
+    const struct spectrum_config_t *c = config_get ();
+    const double f_max = c->pitch * pow (2.0, (c->note_max - 57.0 - c->transpose) / 12.0);
+    const double f_top = MIN (f_max, nyquist);
+    const double bins_per_octave = f_top / 2.0 * c->fft_size / samplerate;
+    const double num_octaves = num_notes / 12.0;
+
+    return MAX ((int)ceil (bins_per_octave * num_octaves), num_notes);
+}
+
 int
-get_num_bars (int width)
+get_num_bars (int width, int samplerate)
 {
-    if (config_get_int (ID_DRAW_STYLE) == SOLID_STYLE) {
-        return num_bars_for_width (width);
+    const int style = config_get ()->draw_style;
+    if (style == SOLID_STYLE || style == SPECTROGRAM_STYLE) {
+        // Bands are computed at the coarser of pixel and FFT resolution,
+        // the renderer resamples them to the width of the widget
+        return MIN (num_bars_for_width (width), num_bars_for_fft (samplerate));
     }
 
     return get_num_notes ();
 }
 
-void
-window_table_fill (double *window)
+int
+get_scale_factor (GtkWidget *widget)
 {
-    const int fft_size = config_get_int (ID_FFT_SIZE);
-    switch (config_get_int (ID_WINDOW)) {
-        case BLACKMAN_HARRIS_WINDOW:
-            for (int i = 0; i < fft_size; i++) {
-                // Blackman-Harris
-                window[i] = 0.35875 - 0.48829 * cos(2 * M_PI * i / fft_size) + 0.14128 * cos(4 * M_PI * i / fft_size) - 0.01168 * cos(6 * M_PI * i / fft_size);
-                window[i] *= 2.7;
-            }
-            break;
-        case HANNING_WINDOW:
-            for (int i = 0; i < fft_size; i++) {
-                // Hanning
-                window[i] = (0.5 * (1 - cos (2 * M_PI * i / fft_size)));
-                window[i] *= 2;
-            }
-            break;
-        case NO_WINDOW:
-            for (int i = 0; i < fft_size; i++) {
-                window[i] = 1;
-            }
-            break;
-        default:
-            break;
-    }
+#if GTK_CHECK_VERSION(3,10,0)
+    return MAX (gtk_widget_get_scale_factor (widget), 1);
+#else
+    return 1;
+#endif
 }
 
 void
-update_gravity (struct spectrum_render_t *render)
+update_gravity (struct spectrum_render_t *render, double interval)
 {
-    const int refresh_interval = config_get_int (ID_REFRESH_INTERVAL);
-    render->peak_delay = (int)ceil (config_get_int (ID_PEAK_DELAY)/refresh_interval);
-    render->bar_delay = (int)ceil (config_get_int (ID_BAR_DELAY)/refresh_interval);
+    render->interval = interval;
+    render->peak_delay = (int)ceil (config_get_int (ID_PEAK_DELAY)/interval);
+    render->bar_delay = (int)ceil (config_get_int (ID_BAR_DELAY)/interval);
 
     const double peak_gravity = config_get_int (ID_PEAK_FALLOFF)/(1000.0 * 1000.0);
-    render->peak_velocity = peak_gravity * refresh_interval;
+    render->peak_velocity = peak_gravity * interval;
 
     const double bars_gravity = config_get_int (ID_BAR_FALLOFF)/(1000.0 * 1000.0);
-    render->bar_velocity = bars_gravity * refresh_interval;
+    render->bar_velocity = bars_gravity * interval;
 }
 
 int
 get_num_notes ()
 {
-    return config_get_int (ID_NOTE_MAX) - config_get_int (ID_NOTE_MIN) + 1;
+    return config_get ()->num_notes;
 }
 
 void
 create_frequency_table (struct spectrum_data_t *s, int samplerate, int num_bars)
 {
+    const struct spectrum_config_t *c = config_get ();
     s->low_res_end = 0;
 
-    const double note_size = num_bars / (double)(get_num_notes ());
-    const double a4pos = (57.0 + config_get_int (ID_TRANSPOSE) - config_get_int (ID_NOTE_MIN)) * note_size;
+    const double note_size = num_bars / (double)c->num_notes;
+    const double a4pos = (57.0 + c->transpose - c->note_min) * note_size;
     const double octave = 12.0 * note_size;
-    const double d_freq = config_get_int (ID_FFT_SIZE)/(double)samplerate;
+    const double d_freq = c->fft_size/(double)samplerate;
 
     for (int i = 0; i < num_bars; i++) {
-        s->frequency[i] = (double)config_get_int (ID_PITCH) * pow (2.0, (double)(i-a4pos)/octave);
+        s->frequency[i] = (double)c->pitch * pow (2.0, (double)(i-a4pos)/octave);
         s->keys[i] = (int)round (s->frequency[i] * d_freq);
         if (i > 0 && s->keys[i] > 0 && s->keys[i-1] == s->keys[i]) {
             s->low_res_end = i;
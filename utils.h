@@ -25,16 +25,16 @@
 #include "spectrum.h"
 
 int
-get_num_bars (int width);
+get_num_bars (int width, int samplerate);
 
 int
 get_num_notes ();
 
-void
-update_gravity (struct spectrum_render_t *render);
+int
+get_scale_factor (GtkWidget *widget);
 
 void
-window_table_fill (double *window);
+update_gravity (struct spectrum_render_t *render, double interval);
 
 void
 create_frequency_table (struct spectrum_data_t *s, int samplerate, int num_bars);
@@ -0,0 +1,166 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include <stdlib.h>
+#include <math.h>
+
+#include "config.h"
+#include "spectrum.h"
+#include "window.h"
+#include "trace.h"
+
+// Parameters of the windows with an adjustable shape
+#define KAISER_BETA 9.0
+#define GAUSSIAN_SIGMA 0.4
+
+struct spectrum_window_t {
+    int type;
+    int size;
+    double *table;
+    struct spectrum_window_t *next;
+};
+
+static struct spectrum_window_t *windows = NULL;
+static intptr_t windows_mutex = 0;
+
+// Sum of cosines, the window of Hann, Blackman-Harris, Nuttall and the flat top
+static void
+window_cosine_sum (double *window, int size, const double *a, int n)
+{
+    for (int i = 0; i < size; i++) {
+        double w = 0;
+        for (int k = 0; k < n; k++) {
+            w += (k % 2 ? -a[k] : a[k]) * cos (2 * M_PI * k * i / size);
+        }
+        window[i] = w;
+    }
+}
+
+// Modified Bessel function of the first kind and order zero
+static double
+bessel_i0 (double x)
+{
+    double sum = 1;
+    double term = 1;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+static void
+window_table_fill (double *window, int window_type, int size)
+{
+    static const double hanning[] = {0.5, 0.5};
+    static const double blackman_harris[] = {0.35875, 0.48829, 0.14128, 0.01168};
+    static const double nuttall[] = {0.355768, 0.487396, 0.144232, 0.012604};
+    static const double flat_top[] = {0.21557895, 0.41663158, 0.277263158, 0.083578947, 0.006947368};
+
+    switch (window_type) {
+        case BLACKMAN_HARRIS_WINDOW:
+            window_cosine_sum (window, size, blackman_harris, 4);
+            break;
+        case HANNING_WINDOW:
+            window_cosine_sum (window, size, hanning, 2);
+            break;
+        case NUTTALL_WINDOW:
+            window_cosine_sum (window, size, nuttall, 4);
+            break;
+        case FLAT_TOP_WINDOW:
+            window_cosine_sum (window, size, flat_top, 5);
+            break;
+        case KAISER_WINDOW:
+            for (int i = 0; i < size; i++) {
+                const double x = 2.0 * i / size - 1;
+                window[i] = bessel_i0 (KAISER_BETA * sqrt (1 - x * x));
+            }
+            break;
+        case GAUSSIAN_WINDOW:
+            for (int i = 0; i < size; i++) {
+                const double x = (i - size / 2.0) / (GAUSSIAN_SIGMA * size / 2.0);
+                window[i] = exp (-0.5 * x * x);
+            }
+            break;
+        case NO_WINDOW:
+        default:
+            for (int i = 0; i < size; i++) {
+                window[i] = 1;
+            }
+            break;
+    }
+
+    // coherent gain normalization
+    double sum = 0;
+    for (int i = 0; i < size; i++) {
+        sum += window[i];
+    }
+    const double gain = size / sum;
+    for (int i = 0; i < size; i++) {
+        window[i] *= gain;
+    }
+}
+
+void
+spectrum_window_init (void)
+{
+    windows_mutex = deadbeef->mutex_create ();
+}
+
+void
+spectrum_window_cleanup (void)
+{
+    while (windows) {
+        struct spectrum_window_t *next = windows->next;
+        free (windows->table);
+        windows->table = NULL;
+        free (windows);
+        windows = next;
+    }
+    if (windows_mutex) {
+        deadbeef->mutex_free (windows_mutex);
+        windows_mutex = 0;
+    }
+}
+
+const double *
+spectrum_window_get (int window_type, int fft_size)
+{
+    deadbeef->mutex_lock (windows_mutex);
+    struct spectrum_window_t *w = windows;
+    while (w && (w->type != window_type || w->size != fft_size)) {
+        w = w->next;
+    }
+    if (!w) {
+        w = calloc (1, sizeof (struct spectrum_window_t));
+        w->type = window_type;
+        w->size = fft_size;
+        w->table = malloc (fft_size * sizeof (double));
+        const gint64 start = spectrum_trace_begin ();
+        window_table_fill (w->table, window_type, fft_size);
+        spectrum_trace_end ("window_table", start);
+        w->next = windows;
+        windows = w;
+    }
+    deadbeef->mutex_unlock (windows_mutex);
+    return w->table;
+}
@@ -0,0 +1,35 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#pragma once
+
+// Window tables are computed once per type and size and kept until the
+// plugin stops, switching back to a window which was used before is free.
+// They are normalized to a coherent gain of one, so a sine wave shows the
+// same amplitude with every window.
+
+void
+spectrum_window_init (void);
+
+void
+spectrum_window_cleanup (void);
+
+// The returned table has fft_size values and must not be modified
+const double *
+spectrum_window_get (int window_type, int fft_size);
@@ -0,0 +1,260 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <gtk/gtk.h>
+
+#include "spectrum.h"
+#include "config.h"
+#include "worker.h"
+#include "trace.h"
+
+static gboolean
+spectrum_worker_ready_cb (gpointer user_data)
+{
+    struct spectrum_worker_t *worker = user_data;
+    deadbeef->mutex_lock (worker->mutex);
+    worker->ready_pending = 0;
+    deadbeef->mutex_unlock (worker->mutex);
+
+    worker->ready (worker->ctx);
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+spectrum_worker_source_dispatch (GSource *source, GSourceFunc callback, gpointer user_data)
+{
+    // Sleep until the next frame is finished
+    g_source_set_ready_time (source, -1);
+    return callback (user_data);
+}
+
+static GSourceFuncs spectrum_worker_source_funcs = {
+    .dispatch = spectrum_worker_source_dispatch,
+};
+
+static int
+spectrum_worker_surface_matches (cairo_surface_t *surface, int width, int height, int scale)
+{
+    return cairo_image_surface_get_width (surface) == width * scale && cairo_image_surface_get_height (surface) == height * scale;
+}
+
+// Frames are drawn in device pixels, so the compositor doesn't have to scale them
+static cairo_surface_t *
+spectrum_worker_surface_get (cairo_surface_t *surface, int width, int height, int scale)
+{
+    if (surface) {
+        if (spectrum_worker_surface_matches (surface, width, height, scale)) {
+            return surface;
+        }
+        cairo_surface_destroy (surface);
+    }
+    surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width * scale, height * scale);
+    cairo_surface_set_device_scale (surface, scale, scale);
+    return surface;
+}
+
+static void
+spectrum_worker_thread (void *ctx)
+{
+    struct spectrum_worker_t *worker = ctx;
+    spectrum_trace_thread_name ("render worker");
+
+    deadbeef->mutex_lock (worker->mutex);
+    while (1) {
+        while (!worker->requested && !worker->terminate) {
+            deadbeef->cond_wait (worker->cond, worker->mutex);
+        }
+        if (worker->terminate) {
+            break;
+        }
+        worker->requested = 0;
+        const int width = worker->width;
+        const int height = worker->height;
+        const int scale = worker->scale;
+        const int back = !worker->front;
+        // Only the worker touches the back buffer, no need to hold the lock while drawing
+        cairo_surface_t *surface = worker->surfaces[back];
+        deadbeef->mutex_unlock (worker->mutex);
+
+        surface = spectrum_worker_surface_get (surface, width, height, scale);
+
+        deadbeef->mutex_lock (worker->frame_mutex);
+        const gint64 start = g_get_monotonic_time ();
+        cairo_t *cr = cairo_create (surface);
+        const double change = worker->draw (worker->ctx, cr, width, height);
+        cairo_destroy (cr);
+        cairo_surface_flush (surface);
+        const double cost = (g_get_monotonic_time () - start) / 1000.0;
+        deadbeef->mutex_unlock (worker->frame_mutex);
+
+        deadbeef->mutex_lock (worker->mutex);
+        worker->surfaces[back] = surface;
+        worker->front = back;
+        worker->cost = cost;
+        worker->change = change;
+        if (!worker->ready_pending) {
+            worker->ready_pending = 1;
+            g_source_set_ready_time (worker->ready_source, 0);
+        }
+    }
+    deadbeef->mutex_unlock (worker->mutex);
+    // Drop the config snapshot the draw callback might have pinned
+    config_use (NULL);
+}
+
+struct spectrum_worker_t *
+spectrum_worker_new (spectrum_worker_draw_func draw, spectrum_worker_ready_func ready, void *ctx)
+{
+    struct spectrum_worker_t *worker = calloc (1, sizeof (struct spectrum_worker_t));
+    worker->draw = draw;
+    worker->ready = ready;
+    worker->ctx = ctx;
+    worker->mutex = deadbeef->mutex_create ();
+    worker->frame_mutex = deadbeef->mutex_create ();
+    worker->cond = deadbeef->cond_create ();
+    worker->ready_source = g_source_new (&spectrum_worker_source_funcs, sizeof (GSource));
+    g_source_set_priority (worker->ready_source, G_PRIORITY_DEFAULT_IDLE);
+    g_source_set_callback (worker->ready_source, spectrum_worker_ready_cb, worker, NULL);
+    g_source_attach (worker->ready_source, NULL);
+    return worker;
+}
+
+void
+spectrum_worker_free (struct spectrum_worker_t *worker)
+{
+    if (!worker) {
+        return;
+    }
+    if (worker->tid) {
+        deadbeef->mutex_lock (worker->mutex);
+        worker->terminate = 1;
+        deadbeef->cond_signal (worker->cond);
+        deadbeef->mutex_unlock (worker->mutex);
+        deadbeef->thread_join (worker->tid);
+        worker->tid = 0;
+    }
+
+    if (worker->ready_source) {
+        g_source_destroy (worker->ready_source);
+        g_source_unref (worker->ready_source);
+        worker->ready_source = NULL;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (worker->surfaces[i]) {
+            cairo_surface_destroy (worker->surfaces[i]);
+            worker->surfaces[i] = NULL;
+        }
+    }
+    deadbeef->cond_free (worker->cond);
+    deadbeef->mutex_free (worker->frame_mutex);
+    deadbeef->mutex_free (worker->mutex);
+    free (worker);
+    worker = NULL;
+}
+
+void
+spectrum_worker_request (struct spectrum_worker_t *worker, int width, int height, int scale)
+{
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    // The thread is started with the first frame, widgets which are never
+    // shown don't need one
+    if (!worker->tid) {
+        worker->tid = deadbeef->thread_start (spectrum_worker_thread, worker);
+    }
+    deadbeef->mutex_lock (worker->mutex);
+    worker->width = width;
+    worker->height = height;
+    worker->scale = MAX (scale, 1);
+    worker->requested = 1;
+    deadbeef->cond_signal (worker->cond);
+    deadbeef->mutex_unlock (worker->mutex);
+}
+
+int
+spectrum_worker_paint (struct spectrum_worker_t *worker, cairo_t *cr, int width, int height, int scale,
+                       cairo_rectangle_t *extents)
+{
+    int res = 0;
+    *extents = (cairo_rectangle_t){0, 0, 0, 0};
+    // The worker waits for us before reusing the front buffer
+    deadbeef->mutex_lock (worker->mutex);
+    cairo_surface_t *surface = worker->surfaces[worker->front];
+    if (surface) {
+        cairo_set_source_surface (cr, surface, 0, 0);
+        cairo_paint (cr);
+        res = spectrum_worker_surface_matches (surface, width, height, MAX (scale, 1));
+        // the surface has the device scale it was drawn at
+        double x_scale = 1, y_scale = 1;
+        cairo_surface_get_device_scale (surface, &x_scale, &y_scale);
+        extents->width = cairo_image_surface_get_width (surface) / x_scale;
+        extents->height = cairo_image_surface_get_height (surface) / y_scale;
+    }
+    deadbeef->mutex_unlock (worker->mutex);
+    return res;
+}
+
+double
+spectrum_worker_cost_get (struct spectrum_worker_t *worker)
+{
+    deadbeef->mutex_lock (worker->mutex);
+    const double cost = worker->cost;
+    deadbeef->mutex_unlock (worker->mutex);
+    return cost;
+}
+
+double
+spectrum_worker_change_get (struct spectrum_worker_t *worker)
+{
+    deadbeef->mutex_lock (worker->mutex);
+    const double change = worker->change;
+    deadbeef->mutex_unlock (worker->mutex);
+    return change;
+}
+
+void
+spectrum_worker_stats_set (struct spectrum_worker_t *worker, const char *text)
+{
+    deadbeef->mutex_lock (worker->mutex);
+    snprintf (worker->stats, sizeof (worker->stats), "%s", text);
+    deadbeef->mutex_unlock (worker->mutex);
+}
+
+void
+spectrum_worker_stats_get (struct spectrum_worker_t *worker, char *text, size_t size)
+{
+    deadbeef->mutex_lock (worker->mutex);
+    snprintf (text, size, "%s", worker->stats);
+    deadbeef->mutex_unlock (worker->mutex);
+}
+
+void
+spectrum_worker_lock (struct spectrum_worker_t *worker)
+{
+    deadbeef->mutex_lock (worker->frame_mutex);
+}
+
+void
+spectrum_worker_unlock (struct spectrum_worker_t *worker)
+{
+    deadbeef->mutex_unlock (worker->frame_mutex);
+}
@@ -0,0 +1,102 @@
+/*
+    Musical Spectrum plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2019 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <gtk/gtk.h>
+
+#define WORKER_STATS_SIZE 1024
+
+// Draws the frame into an image surface of the given logical size, called on the worker thread.
+// Returns how much the frame changed since the previous one.
+typedef double (*spectrum_worker_draw_func) (void *ctx, cairo_t *cr, int width, int height);
+// Called on the main thread after a new frame got finished
+typedef void (*spectrum_worker_ready_func) (void *ctx);
+
+struct spectrum_worker_t {
+    // started by the first request
+    intptr_t tid;
+    // protects the fields below
+    intptr_t mutex;
+    uintptr_t cond;
+    int requested;
+    int terminate;
+    int width;
+    int height;
+    // device pixels per logical pixel of the requested frame
+    int scale;
+    // double buffered frames, the worker draws into the one which isn't front
+    cairo_surface_t *surfaces[2];
+    int front;
+    // dispatched on the main thread once a frame is finished, it is attached
+    // for the lifetime of the worker so that frames don't allocate a source
+    GSource *ready_source;
+    int ready_pending;
+    // time it took to draw the last frame in ms
+    double cost;
+    // change of the last frame as returned by the draw function
+    double change;
+    // text the draw function published for the main thread
+    char stats[WORKER_STATS_SIZE];
+
+    // held while a frame gets drawn
+    intptr_t frame_mutex;
+
+    spectrum_worker_draw_func draw;
+    spectrum_worker_ready_func ready;
+    void *ctx;
+};
+
+struct spectrum_worker_t *
+spectrum_worker_new (spectrum_worker_draw_func draw, spectrum_worker_ready_func ready, void *ctx);
+
+void
+spectrum_worker_free (struct spectrum_worker_t *worker);
+
+void
+spectrum_worker_request (struct spectrum_worker_t *worker, int width, int height, int scale);
+
+// Paints the latest frame, returns 1 if it has the given size and scale. A
+// frame of another size is painted as well, extents gets the logical area it
+// covers, which is empty before the first frame.
+int
+spectrum_worker_paint (struct spectrum_worker_t *worker, cairo_t *cr, int width, int height, int scale,
+                       cairo_rectangle_t *extents);
+
+double
+spectrum_worker_cost_get (struct spectrum_worker_t *worker);
+
+double
+spectrum_worker_change_get (struct spectrum_worker_t *worker);
+
+// Hands a text from the draw function to the main thread, which reads it
+// without waiting for the frame in progress
+void
+spectrum_worker_stats_set (struct spectrum_worker_t *worker, const char *text);
+
+void
+spectrum_worker_stats_get (struct spectrum_worker_t *worker, char *text, size_t size);
+
+void
+spectrum_worker_lock (struct spectrum_worker_t *worker);
+
+void
+spectrum_worker_unlock (struct spectrum_worker_t *worker);